@@ -20,6 +20,9 @@ class value_extractor {
  public:
   void extract(const node& n, string& value) const;
 
+  // Whether the extracted value depends on the deprel, i.e., can change during parsing.
+  bool uses_deprel() const { return selector == DEPREL; }
+
   bool create(string_piece description, string& error);
 
  private:
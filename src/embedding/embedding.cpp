@@ -18,55 +18,109 @@
 namespace ufal {
 namespace parsito {
 
-int embedding::lookup_word(const string& word, string& buffer) const {
+int embedding::lookup_word(string_piece word, string& buffer) const {
   using namespace unilib;
 
-  auto it = dictionary.find(word);
-  if (it != dictionary.end()) return it->second;
+  int id = dictionary.find(word);
+  if (id >= 0) return id;
 
   // We now apply several heuristics to find a match
 
-  // Try locating uppercase/titlecase characters which we could lowercase
+  // ASCII words are handled without UTF-8 decoding and Unicode tables
+  size_t ascii = 0;
+  while (ascii < word.len && (unsigned char)word.str[ascii] < 0x80) ascii++;
+  if (ascii == word.len) return lookup_ascii_word(word, buffer);
+
+  // Decode the word once, computing the categories of the first and the other
+  // characters, and the word with all characters but the first lowercased
   bool first = true;
+  char32_t first_chr = 0;
+  size_t first_len = 0;
   unicode::category_t first_category = 0, other_categories = 0;
-  for (auto&& chr : utf8::decoder(word)) {
-    (first ? first_category : other_categories) |= unicode::category(chr);
-    first = false;
+  buffer.clear();
+  for (auto&& chr : utf8::decoder(word.str, word.len)) {
+    if (first) {
+      first_category = unicode::category(chr);
+      first_chr = chr;
+      utf8::append(buffer, chr);
+      first_len = buffer.size();
+      first = false;
+    } else {
+      other_categories |= unicode::category(chr);
+      utf8::append(buffer, unicode::lowercase(chr));
+    }
   }
 
+  // Try locating uppercase/titlecase characters which we could lowercase
   if ((first_category & unicode::Lut) && (other_categories & unicode::Lut)) {
     // Lowercase all characters but the first
-    buffer.clear();
-    first = true;
-    for (auto&& chr : utf8::decoder(word)) {
-      utf8::append(buffer, first ? chr : unicode::lowercase(chr));
-      first = false;
-    }
-
-    it = dictionary.find(buffer);
-    if (it != dictionary.end()) return it->second;
+    id = dictionary.find(buffer);
+    if (id >= 0) return id;
   }
 
   if ((first_category & unicode::Lut) || (other_categories & unicode::Lut)) {
-    utf8::map(unicode::lowercase, word, buffer);
+    // Lowercase also the first character
+    char first_lowercased[4], *first_lowercased_end = first_lowercased;
+    utf8::append(first_lowercased_end, unicode::lowercase(first_chr));
+    buffer.replace(0, first_len, first_lowercased, first_lowercased_end - first_lowercased);
 
-    it = dictionary.find(buffer);
-    if (it != dictionary.end()) return it->second;
+    id = dictionary.find(buffer);
+    if (id >= 0) return id;
   }
 
   // If the word starts with digit and contain only digits and non-letter characters
   // i.e. large number, date, time, try replacing it with first digit only.
   if ((first_category & unicode::N) && !(other_categories & unicode::L)) {
     buffer.clear();
-    utf8::append(buffer, utf8::first(word));
+    utf8::append(buffer, first_chr);
+
+    id = dictionary.find(buffer);
+    if (id >= 0) return id;
+  }
+
+  return unknown_index;
+}
+
+int embedding::lookup_ascii_word(string_piece word, string& buffer) const {
+  // The same heuristics as in lookup_word, with A-Z being the only
+  // uppercase characters, a-z and A-Z the only letters and 0-9 the only digits
+  bool first_upper = word.len && word.str[0] >= 'A' && word.str[0] <= 'Z';
+  bool other_upper = false, other_letter = false;
+  for (size_t i = 1; i < word.len; i++) {
+    other_upper |= word.str[i] >= 'A' && word.str[i] <= 'Z';
+    other_letter |= (word.str[i] | 0x20) >= 'a' && (word.str[i] | 0x20) <= 'z';
+  }
+
+  if (first_upper || other_upper) {
+    buffer.assign(word.str, word.len);
+    for (size_t i = 1; i < buffer.size(); i++)
+      if (buffer[i] >= 'A' && buffer[i] <= 'Z') buffer[i] += 'a' - 'A';
+
+    int id;
+    if (first_upper && other_upper) {
+      id = dictionary.find(buffer);
+      if (id >= 0) return id;
+    }
 
-    it = dictionary.find(buffer);
-    if (it != dictionary.end()) return it->second;
+    if (first_upper) buffer[0] += 'a' - 'A';
+    id = dictionary.find(buffer);
+    if (id >= 0) return id;
   }
 
+  // The ids of the single digits are precomputed
+  if (word.len && word.str[0] >= '0' && word.str[0] <= '9' && !other_letter && digit_ids[word.str[0] - '0'] >= 0)
+    return digit_ids[word.str[0] - '0'];
+
   return unknown_index;
 }
 
+void embedding::prepare_lookup() {
+  for (int digit = 0; digit < 10; digit++) {
+    char digit_str = '0' + digit;
+    digit_ids[digit] = dictionary.find(string_piece(&digit_str, 1));
+  }
+}
+
 int embedding::unknown_word() const {
   return unknown_index;
 }
@@ -90,11 +144,15 @@ void embedding::load(binary_decoder& data) {
   // Load dictionary
   dictionary.clear();
   string word;
-  for (unsigned size = data.next_4B(); size; size--) {
+  unsigned size = data.next_4B();
+  dictionary.reserve(size);
+  for (; size; size--) {
     data.next_str(word);
-    dictionary.emplace(word, (int)dictionary.size());
+    dictionary.add(word);
   }
 
+  prepare_lookup();
+
   unknown_index = data.next_1B() ? dictionary.size() : -1;
 
   // Load weights
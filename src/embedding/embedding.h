@@ -9,10 +9,10 @@
 
 #pragma once
 
-#include <unordered_map>
 #include <utility>
 
 #include "common.h"
+#include "embedding_dictionary.h"
 #include "utils/binary_decoder.h"
 #include "utils/binary_encoder.h"
 #include "utils/string_piece.h"
@@ -24,7 +24,7 @@ class embedding {
  public:
   unsigned dimension;
 
-  int lookup_word(const string& word, string& buffer) const;
+  int lookup_word(string_piece word, string& buffer) const;
   int unknown_word() const;
   float* weight(int id); // nullptr for wrong id
   const float* weight(int id) const; // nullpt for wrong id
@@ -37,9 +37,13 @@ class embedding {
   void create(unsigned dimension, int updatable_index, const vector<pair<string, vector<float>>>& words, const vector<float>& unknown_weights);
   void export_embeddings(vector<pair<string, vector<float>>>& words, vector<float>& unknown_weights) const;
  private:
+  int lookup_ascii_word(string_piece word, string& buffer) const;
+  void prepare_lookup();
+
   int updatable_index, unknown_index;
 
-  unordered_map<string, int> dictionary;
+  embedding_dictionary dictionary;
+  int digit_ids[10];
   vector<float> weights;
 };
 
@@ -0,0 +1,84 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cstring>
+
+#include "embedding_dictionary.h"
+
+namespace ufal {
+namespace parsito {
+
+void embedding_dictionary::clear() {
+  pool.clear();
+  offsets.assign(1, 0);
+  table.clear();
+  mask = 0;
+}
+
+void embedding_dictionary::reserve(unsigned words) {
+  offsets.reserve(words + 1);
+
+  // Keep the table at most half full
+  size_t table_size = 16;
+  while (table_size < 2 * size_t(words)) table_size *= 2;
+  if (table_size > table.size()) rehash(table_size);
+}
+
+bool embedding_dictionary::add(string_piece word) {
+  if (2 * (size_t(size()) + 1) > table.size()) rehash(table.size() ? 2 * table.size() : 16);
+
+  uint32_t word_hash = hash(word);
+  size_t i = word_hash & mask;
+  for (; table[i].id >= 0; i = (i + 1) & mask)
+    if (table[i].hash == word_hash && this->word(table[i].id) == word)
+      return false;
+
+  table[i].hash = word_hash;
+  table[i].id = size();
+  pool.append(word.str, word.len);
+  offsets.push_back(pool.size());
+  return true;
+}
+
+int embedding_dictionary::find(string_piece word) const {
+  if (table.empty()) return -1;
+
+  uint32_t word_hash = hash(word);
+  for (size_t i = word_hash & mask; table[i].id >= 0; i = (i + 1) & mask)
+    if (table[i].hash == word_hash && this->word(table[i].id) == word)
+      return table[i].id;
+
+  return -1;
+}
+
+uint32_t embedding_dictionary::hash(string_piece word) {
+  // FNV-1a, followed by a final mixing step, because only the low bits are used
+  uint32_t hash = 2166136261U;
+  for (size_t i = 0; i < word.len; i++)
+    hash = (hash ^ (unsigned char)word.str[i]) * 16777619U;
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bU;
+  hash ^= hash >> 13;
+  return hash;
+}
+
+void embedding_dictionary::rehash(size_t table_size) {
+  table.assign(table_size, entry{0, -1});
+  mask = table_size - 1;
+  for (unsigned id = 0; id < size(); id++) {
+    uint32_t word_hash = hash(word(id));
+    size_t i = word_hash & mask;
+    while (table[i].id >= 0) i = (i + 1) & mask;
+    table[i].hash = word_hash;
+    table[i].id = id;
+  }
+}
+
+} // namespace parsito
+} // namespace ufal
@@ -0,0 +1,51 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include "common.h"
+#include "utils/string_piece.h"
+
+namespace ufal {
+namespace parsito {
+
+// Dictionary of embedding words, assigning them consecutive ids. The words
+// are stored in a single string pool and found using an open addressing hash
+// table, which stores the word hashes, so that only one string comparison is
+// usually needed.
+class embedding_dictionary {
+ public:
+  void clear();
+  void reserve(unsigned words);
+
+  unsigned size() const { return offsets.size() - 1; }
+  bool empty() const { return size() == 0; }
+
+  // Add a word with id size(), returning false if it is already present.
+  bool add(string_piece word);
+  // Return id of the word, or -1 if not present.
+  int find(string_piece word) const;
+  string_piece word(unsigned id) const { return string_piece(pool.data() + offsets[id], offsets[id + 1] - offsets[id]); }
+
+ private:
+  static uint32_t hash(string_piece word);
+  void rehash(size_t table_size);
+
+  string pool;
+  vector<uint32_t> offsets = {0};
+  struct entry {
+    uint32_t hash;
+    int id;
+  };
+  vector<entry> table;
+  size_t mask = 0;
+};
+
+} // namespace parsito
+} // namespace ufal
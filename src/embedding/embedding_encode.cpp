@@ -18,14 +18,9 @@ void embedding::save(binary_encoder& enc) const {
   enc.add_4B(dimension);
 
   // Save the dictionary
-  vector<string_piece> words(dictionary.size());
-  for (auto&& entry : dictionary) {
-    assert(entry.second >= 0 && entry.second < int(dictionary.size()));
-    words[entry.second] = entry.first;
-  }
   enc.add_4B(dictionary.size());
-  for (auto&& word : words)
-    enc.add_str(word);
+  for (unsigned i = 0; i < dictionary.size(); i++)
+    enc.add_str(dictionary.word(i));
 
   enc.add_1B(unknown_index >= 0);
 
@@ -45,10 +40,12 @@ void embedding::create(unsigned dimension, int updatable_index, const vector<pai
   weights.clear();
   for (auto&& word : words) {
     assert(word.second.size() == dimension);
-    dictionary.emplace(word.first, (int)dictionary.size());
+    dictionary.add(word.first);
     weights.insert(weights.end(), word.second.begin(), word.second.end());
   }
 
+  prepare_lookup();
+
   if (unknown_weights.empty()) {
     this->unknown_index = -1;
   } else {
@@ -66,9 +63,9 @@ void embedding::export_embeddings(vector<pair<string, vector<float>>>& words, ve
   assert(unknown_index < 0 || unknown_index == int(dictionary.size()));
 
   words.resize(dictionary.size());
-  for (auto&& entry : dictionary) {
-    words[entry.second].first = entry.first;
-    words[entry.second].second.assign(weights.data() + entry.second * dimension, weights.data() + entry.second * dimension + dimension);
+  for (unsigned i = 0; i < dictionary.size(); i++) {
+    words[i].first.assign(dictionary.word(i).str, dictionary.word(i).len);
+    words[i].second.assign(weights.data() + i * dimension, weights.data() + i * dimension + dimension);
   }
   if (unknown_index >= 0)
     unknown_weights.assign(weights.data() + unknown_index * dimension, weights.data() + unknown_index * dimension + dimension);
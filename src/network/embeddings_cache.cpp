@@ -0,0 +1,290 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "embeddings_cache.h"
+#include "utils/binary_decoder.h"
+#include "utils/binary_encoder.h"
+#include "utils/path_from_utf8.h"
+
+namespace ufal {
+namespace parsito {
+
+// The cache file starts with a header padded to CACHE_FILE_ALIGNMENT bytes.
+// Then the rows of all tables follow, each table again padded the same way
+// and followed by its index, if any, also padded.
+// The rows are stored in native byte order, so that they can be mapped.
+static const char CACHE_FILE_MAGIC[] = "PARSITOC";
+enum { CACHE_FILE_VERSION = 2, CACHE_FILE_ALIGNMENT = 64, CACHE_FILE_MAX_HEADER = 4096 };
+
+static size_t align(size_t size) {
+  return (size + CACHE_FILE_ALIGNMENT - 1) / CACHE_FILE_ALIGNMENT * CACHE_FILE_ALIGNMENT;
+}
+
+struct embeddings_cache::mapping {
+  const char* data = nullptr;
+  size_t size = 0;
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE, file_mapping = nullptr;
+#endif
+
+  bool map(const char* file_name);
+  ~mapping();
+};
+
+embeddings_cache::embeddings_cache() : lazy_memory_exhausted(false) {}
+
+embeddings_cache::~embeddings_cache() {}
+
+void embeddings_cache::clear() {
+  tables.clear();
+  storage.reset();
+  storage_indices.clear();
+  mapped.reset();
+
+  lazy = false;
+  lazy_rows.clear();
+  lazy_chunks.clear();
+  lazy_chunk_rows = lazy_chunk_used = lazy_memory_left = 0;
+  lazy_memory_exhausted.store(false);
+}
+
+size_t embeddings_cache::row_size_for(precision_t precision, unsigned sequences, unsigned hidden_layer_size) {
+  switch (precision) {
+    case FLOAT32:
+      return sequences * hidden_layer_size * sizeof(float);
+    case FLOAT16:
+    case BFLOAT16:
+      return (sequences * hidden_layer_size + 1) / 2 * 2 * sizeof(uint16_t);
+    case INT8:
+      // Round the row size up so that the scales of all rows stay aligned
+      return (sequences * (sizeof(float) + hidden_layer_size) + sizeof(float) - 1) / sizeof(float) * sizeof(float);
+  }
+  return 0;
+}
+
+void embeddings_cache::allocate(precision_t precision, unsigned sequences, unsigned hidden_layer_size, const vector<unsigned>& words,
+                                const vector<vector<unsigned>>* selected) {
+  clear();
+
+  this->precision = precision;
+  this->sequences = sequences;
+  this->hidden_layer_size = hidden_layer_size;
+  row_size = row_size_for(precision, sequences, hidden_layer_size);
+
+  tables.resize(words.size());
+  if (selected) storage_indices.resize(words.size());
+  size_t size = 0;
+  for (size_t i = 0; i < words.size(); i++) {
+    tables[i].words = words[i];
+    tables[i].cached = selected ? (*selected)[i].size() : words[i];
+    size += tables[i].cached * row_size;
+
+    if (selected) {
+      storage_indices[i].assign(words[i], NOT_CACHED);
+      for (unsigned row = 0; row < (*selected)[i].size(); row++)
+        storage_indices[i][(*selected)[i][row]] = row;
+      tables[i].index = storage_indices[i].data();
+    }
+  }
+  if (size) storage.reset(new char[size]);
+
+  for (size_t i = 0, offset = 0; i < tables.size(); offset += tables[i].cached * row_size, i++)
+    tables[i].rows = storage.get() + offset;
+}
+
+void embeddings_cache::allocate_lazy(precision_t precision, unsigned sequences, unsigned hidden_layer_size, const vector<unsigned>& words, size_t max_memory) {
+  clear();
+
+  this->precision = precision;
+  this->sequences = sequences;
+  this->hidden_layer_size = hidden_layer_size;
+  row_size = row_size_for(precision, sequences, hidden_layer_size);
+
+  lazy = true;
+  lazy_memory_left = max_memory ? max_memory : size_t(-1);
+
+  tables.resize(words.size());
+  lazy_rows.resize(words.size());
+  for (size_t i = 0; i < words.size(); i++) {
+    tables[i].words = tables[i].cached = words[i];
+    lazy_rows[i].reset(new atomic<const char*>[words[i]]);
+    for (unsigned word = 0; word < words[i]; word++)
+      lazy_rows[i][word].store(nullptr, memory_order_relaxed);
+  }
+}
+
+char* embeddings_cache::lazy_allocate_row() const {
+  // The rows are allocated in chunks; must be called with lazy_mutex held
+  enum { LAZY_CHUNK_SIZE = 1 << 20 };
+
+  if (lazy_chunk_used == lazy_chunk_rows) {
+    size_t chunk_rows = min(max(size_t(1), size_t(LAZY_CHUNK_SIZE) / row_size), lazy_memory_left / row_size);
+    if (!chunk_rows) {
+      lazy_memory_exhausted.store(true, memory_order_relaxed);
+      return nullptr;
+    }
+
+    lazy_chunks.emplace_back(new char[chunk_rows * row_size]);
+    lazy_chunk_rows = chunk_rows;
+    lazy_chunk_used = 0;
+    lazy_memory_left -= chunk_rows * row_size;
+  }
+
+  return lazy_chunks.back().get() + lazy_chunk_used++ * row_size;
+}
+
+bool embeddings_cache::save(ostream& os, uint64_t fingerprint) const {
+  if (lazy) return false;
+
+  binary_encoder enc;
+  enc.add_data(string_piece(CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC) - 1));
+  enc.add_4B(CACHE_FILE_VERSION);
+  enc.add_4B(uint32_t(fingerprint));
+  enc.add_4B(uint32_t(fingerprint >> 32));
+  enc.add_1B(precision);
+  enc.add_4B(sequences);
+  enc.add_4B(hidden_layer_size);
+  enc.add_4B(tables.size());
+  for (auto&& table : tables) {
+    enc.add_4B(table.words);
+    enc.add_4B(table.cached);
+    enc.add_1B(table.index != nullptr);
+  }
+  enc.data.resize(align(enc.data.size()));
+  if (!os.write((const char*)enc.data.data(), enc.data.size())) return false;
+
+  auto write_aligned = [&os](const char* data, size_t size) {
+    static const char padding[CACHE_FILE_ALIGNMENT] = {};
+    return (!size || os.write(data, size)) && (align(size) == size || os.write(padding, align(size) - size));
+  };
+  for (auto&& table : tables) {
+    if (!write_aligned(table.rows, table.cached * row_size)) return false;
+    if (table.index && !write_aligned((const char*)table.index, table.words * sizeof(uint32_t))) return false;
+  }
+
+  return bool(os.flush());
+}
+
+bool embeddings_cache::map(const char* file, uint64_t fingerprint) {
+  clear();
+
+  unique_ptr<mapping> new_mapping(new mapping());
+  if (!new_mapping->map(file)) return false;
+
+  try {
+    binary_decoder data;
+    size_t header_size = min(new_mapping->size, size_t(CACHE_FILE_MAX_HEADER));
+    memcpy(data.fill(header_size), new_mapping->data, header_size);
+
+    if (memcmp(data.next<char>(sizeof(CACHE_FILE_MAGIC) - 1), CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC) - 1) != 0) return false;
+    if (data.next_4B() != CACHE_FILE_VERSION) return false;
+    uint64_t file_fingerprint = data.next_4B();
+    file_fingerprint |= uint64_t(data.next_4B()) << 32;
+    if (file_fingerprint != fingerprint) return false;
+
+    unsigned file_precision = data.next_1B();
+    if (file_precision > INT8) return false;
+    precision = precision_t(file_precision);
+    sequences = data.next_4B();
+    hidden_layer_size = data.next_4B();
+    row_size = row_size_for(precision, sequences, hidden_layer_size);
+
+    tables.resize(data.next_4B());
+    vector<bool> indexed(tables.size());
+    for (size_t i = 0; i < tables.size(); i++) {
+      tables[i].words = data.next_4B();
+      tables[i].cached = data.next_4B();
+      indexed[i] = data.next_1B();
+      if (!indexed[i] && tables[i].cached != tables[i].words) return clear(), false;
+    }
+
+    size_t offset = align(data.tell());
+    for (size_t i = 0; i < tables.size(); i++) {
+      size_t size = tables[i].cached * row_size;
+      if (offset + size > new_mapping->size) return clear(), false;
+      tables[i].rows = new_mapping->data + offset;
+      offset += align(size);
+
+      if (indexed[i]) {
+        size = tables[i].words * sizeof(uint32_t);
+        if (offset + size > new_mapping->size) return clear(), false;
+        tables[i].index = (const uint32_t*)(new_mapping->data + offset);
+        for (unsigned word = 0; word < tables[i].words; word++)
+          if (tables[i].index[word] != NOT_CACHED && tables[i].index[word] >= tables[i].cached) return clear(), false;
+        offset += align(size);
+      }
+    }
+  } catch (binary_decoder_error&) {
+    return clear(), false;
+  }
+
+  mapped = std::move(new_mapping);
+  return true;
+}
+
+#ifdef _WIN32
+bool embeddings_cache::mapping::map(const char* file_name) {
+  file = CreateFileW(path_from_utf8(file_name).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) return false;
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || !file_size.QuadPart) return false;
+  size = size_t(file_size.QuadPart);
+
+  file_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!file_mapping) return false;
+
+  data = (const char*)MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+  return data;
+}
+
+embeddings_cache::mapping::~mapping() {
+  if (data) UnmapViewOfFile(data);
+  if (file_mapping) CloseHandle(file_mapping);
+  if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+#else
+bool embeddings_cache::mapping::map(const char* file_name) {
+  int fd = open(path_from_utf8(file_name).c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || !file_stat.st_size) return close(fd), false;
+  size = size_t(file_stat.st_size);
+
+  void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (address == MAP_FAILED) return false;
+
+  data = (const char*)address;
+  return true;
+}
+
+embeddings_cache::mapping::~mapping() {
+  if (data) munmap((void*)data, size);
+}
+#endif
+
+} // namespace parsito
+} // namespace ufal
@@ -0,0 +1,124 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include "common.h"
+
+namespace ufal {
+namespace parsito {
+
+// Precomputed products of the embeddings and the hidden layer weights.
+// Every cached word of every embedding is stored in a row of row_size bytes.
+// With FLOAT32, FLOAT16 and BFLOAT16 precisions, the row contains
+// sequences * hidden_layer_size values in the respective format; with INT8
+// precision, the row starts with a float scale for every sequence, followed
+// by sequences * hidden_layer_size quantized values.
+//
+// The rows are either allocated and computed during model loading, or they
+// are memory-mapped from a cache file created by save. Alternatively, a lazy
+// cache computes the rows on first use, until its memory limit is exhausted;
+// the lazy rows are filled and retrieved safely from multiple threads.
+class embeddings_cache {
+ public:
+  enum precision_t { FLOAT32, FLOAT16, BFLOAT16, INT8 };
+
+  embeddings_cache();
+  ~embeddings_cache();
+
+  precision_t precision = FLOAT32;
+  unsigned sequences = 0, hidden_layer_size = 0;
+  size_t row_size = 0;
+
+  // Every table caches some of the first words of an embedding. Either all
+  // of them are cached in order, or the index contains the row of every word,
+  // NOT_CACHED for words without a row.
+  enum { NOT_CACHED = ~0U };
+  struct table {
+    unsigned words = 0, cached = 0;
+    const char* rows = nullptr;
+    const uint32_t* index = nullptr;
+  };
+  vector<table> tables;
+
+  bool contains(unsigned embedding, unsigned word) const {
+    return embedding < tables.size() && word < tables[embedding].words && (!tables[embedding].index || tables[embedding].index[word] != NOT_CACHED);
+  }
+  const char* row(unsigned embedding, unsigned word) const {
+    return tables[embedding].rows + (tables[embedding].index ? tables[embedding].index[word] : word) * row_size;
+  }
+
+  // Lazy cache: lazy_row returns nullptr for rows not yet computed, which can
+  // be computed using lazy_fill, unless lazy_exhausted.
+  bool lazy = false;
+  const char* lazy_row(unsigned embedding, unsigned word) const { return lazy_rows[embedding][word].load(memory_order_acquire); }
+  bool lazy_exhausted() const { return lazy_memory_exhausted.load(memory_order_relaxed); }
+  template <class Fill> const char* lazy_fill(unsigned embedding, unsigned word, Fill fill) const;
+
+  // Allocate uninitialized rows for the given number of words of every
+  // embedding, or only for the selected words if given. The rows are then
+  // filled using allocated_row, with the selected words in the given order.
+  void allocate(precision_t precision, unsigned sequences, unsigned hidden_layer_size, const vector<unsigned>& words,
+                const vector<vector<unsigned>>* selected = nullptr);
+  char* allocated_row(unsigned embedding, unsigned row) { return (char*)tables[embedding].rows + row * row_size; }
+
+  // Prepare a lazy cache for the given number of words of every embedding,
+  // using at most max_memory bytes for the rows (0 meaning unlimited).
+  void allocate_lazy(precision_t precision, unsigned sequences, unsigned hidden_layer_size, const vector<unsigned>& words, size_t max_memory);
+
+  // The fingerprint identifies the network and embeddings the cache was
+  // computed for; a cache file is only mapped if the fingerprints match.
+  // A lazy cache cannot be saved.
+  bool save(ostream& os, uint64_t fingerprint) const;
+  bool map(const char* file, uint64_t fingerprint);
+
+  static size_t row_size_for(precision_t precision, unsigned sequences, unsigned hidden_layer_size);
+
+ private:
+  void clear();
+
+  unique_ptr<char[]> storage;
+  vector<vector<uint32_t>> storage_indices;
+
+  struct mapping;
+  unique_ptr<mapping> mapped;
+
+  vector<unique_ptr<atomic<const char*>[]>> lazy_rows;
+  mutable mutex lazy_mutex;
+  mutable vector<unique_ptr<char[]>> lazy_chunks;
+  mutable size_t lazy_chunk_rows = 0, lazy_chunk_used = 0, lazy_memory_left = 0;
+  mutable atomic<bool> lazy_memory_exhausted;
+
+  char* lazy_allocate_row() const;
+};
+
+//
+// Definitions
+//
+
+template <class Fill>
+const char* embeddings_cache::lazy_fill(unsigned embedding, unsigned word, Fill fill) const {
+  lock_guard<mutex> lock(lazy_mutex);
+
+  // The row might have been filled by another thread in the meantime
+  if (const char* row = lazy_row(embedding, word)) return row;
+
+  char* row = lazy_allocate_row();
+  if (!row) return nullptr;
+
+  fill(row);
+  lazy_rows[embedding][word].store(row, memory_order_release);
+  return row;
+}
+
+} // namespace parsito
+} // namespace ufal
@@ -0,0 +1,110 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "embeddings_profile.h"
+#include "utils/binary_decoder.h"
+#include "utils/binary_encoder.h"
+
+namespace ufal {
+namespace parsito {
+
+static const char PROFILE_FILE_MAGIC[] = "PARSITOP";
+enum { PROFILE_FILE_VERSION = 1 };
+
+void embeddings_profile::init(const vector<unsigned>& words) {
+  this->words = words;
+
+  counts.clear();
+  for (auto&& embedding_words : words) {
+    counts.emplace_back(new atomic<uint32_t>[embedding_words]);
+    for (unsigned word = 0; word < embedding_words; word++)
+      counts.back()[word].store(0, memory_order_relaxed);
+  }
+}
+
+bool embeddings_profile::save(ostream& os) const {
+  binary_encoder enc;
+  enc.add_data(string_piece(PROFILE_FILE_MAGIC, sizeof(PROFILE_FILE_MAGIC) - 1));
+  enc.add_4B(PROFILE_FILE_VERSION);
+  enc.add_4B(words.size());
+  for (unsigned i = 0; i < words.size(); i++) {
+    enc.add_4B(words[i]);
+    for (unsigned word = 0; word < words[i]; word++)
+      enc.add_4B(counts[i][word].load(memory_order_relaxed));
+  }
+
+  return os.write((const char*)enc.data.data(), enc.data.size()) && os.flush();
+}
+
+bool embeddings_profile::load(istream& is) {
+  string content((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+
+  try {
+    binary_decoder data;
+    memcpy(data.fill(content.size()), content.data(), content.size());
+
+    if (memcmp(data.next<char>(sizeof(PROFILE_FILE_MAGIC) - 1), PROFILE_FILE_MAGIC, sizeof(PROFILE_FILE_MAGIC) - 1) != 0) return false;
+    if (data.next_4B() != PROFILE_FILE_VERSION) return false;
+
+    vector<unsigned> file_words(data.next_4B());
+    vector<vector<uint32_t>> file_counts(file_words.size());
+    for (unsigned i = 0; i < file_words.size(); i++) {
+      file_words[i] = data.next_4B();
+      file_counts[i].resize(file_words[i]);
+      for (auto&& count : file_counts[i])
+        count = data.next_4B();
+    }
+    if (!data.is_end()) return false;
+
+    init(file_words);
+    for (unsigned i = 0; i < file_words.size(); i++)
+      for (unsigned word = 0; word < file_words[i]; word++)
+        counts[i][word].store(file_counts[i][word], memory_order_relaxed);
+  } catch (binary_decoder_error&) {
+    return false;
+  }
+
+  return true;
+}
+
+void embeddings_profile::select(unsigned max_words, size_t max_rows, vector<vector<unsigned>>& selected) const {
+  struct candidate {
+    uint32_t count;
+    unsigned embedding, word;
+  };
+  vector<candidate> candidates;
+  for (unsigned i = 0; i < words.size(); i++)
+    for (unsigned word = 0; word < words[i]; word++)
+      if (uint32_t count = counts[i][word].load(memory_order_relaxed))
+        candidates.push_back({count, i, word});
+
+  // The most frequent words first, ties broken by embedding and word ids
+  sort(candidates.begin(), candidates.end(), [](const candidate& a, const candidate& b) {
+    return a.count > b.count || (a.count == b.count && (a.embedding < b.embedding || (a.embedding == b.embedding && a.word < b.word)));
+  });
+
+  selected.assign(words.size(), vector<unsigned>());
+  size_t rows = 0;
+  for (auto&& candidate : candidates) {
+    if (rows >= max_rows) break;
+    if (selected[candidate.embedding].size() >= max_words) continue;
+    selected[candidate.embedding].push_back(candidate.word);
+    rows++;
+  }
+
+  for (auto&& embedding_selected : selected)
+    sort(embedding_selected.begin(), embedding_selected.end());
+}
+
+} // namespace parsito
+} // namespace ufal
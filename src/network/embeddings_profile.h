@@ -0,0 +1,62 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <atomic>
+
+#include "common.h"
+
+namespace ufal {
+namespace parsito {
+
+// Number of lookups of every word of every embedding, gathered while parsing
+// a sample corpus. The profile is used to choose the words to cache, so the
+// cache contains the most frequent words of the expected data instead of
+// the first words of the embeddings.
+class embeddings_profile {
+ public:
+  // Start profiling the given number of words of every embedding.
+  void init(const vector<unsigned>& words);
+  bool empty() const { return counts.empty(); }
+  const vector<unsigned>& profiled_words() const { return words; }
+
+  // Record the lookups of the given embedding ids; safe to call from
+  // multiple threads concurrently.
+  inline void add(const vector<const vector<int>*>& embedding_ids_sequences) const;
+
+  bool save(ostream& os) const;
+  bool load(istream& is);
+
+  // Choose the most frequent profiled words, at most max_words for every
+  // embedding and at most max_rows in total. The chosen words of every
+  // embedding are returned in increasing order.
+  void select(unsigned max_words, size_t max_rows, vector<vector<unsigned>>& selected) const;
+
+ private:
+  vector<unsigned> words;
+  vector<unique_ptr<atomic<uint32_t>[]>> counts;
+};
+
+//
+// Definitions
+//
+
+void embeddings_profile::add(const vector<const vector<int>*>& embedding_ids_sequences) const {
+  for (auto&& embedding_ids : embedding_ids_sequences)
+    if (embedding_ids)
+      for (unsigned i = 0; i < embedding_ids->size() && i < counts.size(); i++) {
+        int word = (*embedding_ids)[i];
+        if (word >= 0 && unsigned(word) < words[i])
+          counts[i][word].fetch_add(1, memory_order_relaxed);
+      }
+}
+
+} // namespace parsito
+} // namespace ufal
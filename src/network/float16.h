@@ -0,0 +1,100 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <cstring>
+
+#include "common.h"
+
+namespace ufal {
+namespace parsito {
+
+// Conversions between floats and the IEEE half-precision (float16) and
+// bfloat16 formats, both rounding to nearest even.
+inline uint16_t float_to_float16(float value);
+inline float float16_to_float(uint16_t value);
+inline uint16_t float_to_bfloat16(float value);
+inline float bfloat16_to_float(uint16_t value);
+
+//
+// Definitions
+//
+
+uint16_t float_to_float16(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  uint32_t sign = bits & 0x80000000U;
+  bits ^= sign;
+
+  uint16_t result;
+  if (bits >= (127U + 16) << 23) {
+    // Infinity or NaN
+    result = bits > 255U << 23 ? 0x7E00 : 0x7C00;
+  } else if (bits < 113U << 23) {
+    // Subnormal or zero; the float addition performs the rounding
+    const uint32_t magic_bits = (127U - 15 + 23 - 10 + 1) << 23;
+    float magic, rounded;
+    memcpy(&magic, &magic_bits, sizeof(magic));
+    memcpy(&rounded, &bits, sizeof(rounded));
+    rounded += magic;
+    memcpy(&bits, &rounded, sizeof(bits));
+    result = bits - magic_bits;
+  } else {
+    uint32_t mantissa_odd = (bits >> 13) & 1;
+    bits += ((15U - 127) << 23) + 0xFFF + mantissa_odd;
+    result = bits >> 13;
+  }
+  return result | (sign >> 16);
+}
+
+float float16_to_float(uint16_t value) {
+  const uint32_t exponent_mask = 0x7C00U << 13;
+
+  uint32_t bits = (value & 0x7FFFU) << 13;
+  uint32_t exponent = bits & exponent_mask;
+  bits += (127U - 15) << 23;
+
+  float result;
+  if (exponent == exponent_mask) {
+    // Infinity or NaN
+    bits += (128U - 16) << 23;
+    memcpy(&result, &bits, sizeof(result));
+  } else if (exponent == 0) {
+    // Subnormal or zero
+    const uint32_t magic_bits = 113U << 23;
+    float magic;
+    memcpy(&magic, &magic_bits, sizeof(magic));
+    bits += 1U << 23;
+    memcpy(&result, &bits, sizeof(result));
+    result -= magic;
+  } else {
+    memcpy(&result, &bits, sizeof(result));
+  }
+  return (value & 0x8000U) ? -result : result;
+}
+
+uint16_t float_to_bfloat16(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  if ((bits & 0x7FFFFFFFU) > 0x7F800000U) return (bits >> 16) | 0x40; // NaN
+  return (bits + 0x7FFF + ((bits >> 16) & 1)) >> 16;
+}
+
+float bfloat16_to_float(uint16_t value) {
+  uint32_t bits = uint32_t(value) << 16;
+  float result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+} // namespace parsito
+} // namespace ufal
@@ -0,0 +1,62 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <cstring>
+
+#include "common.h"
+
+namespace ufal {
+namespace parsito {
+
+// Row-major float matrix stored in a single 64B-aligned buffer. Every row is
+// padded by zeros to a multiple of 16 floats, so that all rows are aligned.
+class matrix {
+ public:
+  enum { ALIGNMENT = 64, ALIGNMENT_FLOATS = ALIGNMENT / sizeof(float) };
+
+  matrix() {}
+  matrix(const matrix& other) { *this = other; }
+  inline matrix& operator=(const matrix& other);
+
+  unsigned rows = 0, columns = 0, stride = 0;
+
+  bool empty() const { return !rows; }
+  inline void resize(unsigned rows, unsigned columns); // all elements are set to zero
+
+  float* operator[](unsigned row) { return data + size_t(row) * stride; }
+  const float* operator[](unsigned row) const { return data + size_t(row) * stride; }
+
+ private:
+  unique_ptr<float[]> storage;
+  float* data = nullptr;
+};
+
+matrix& matrix::operator=(const matrix& other) {
+  if (this != &other) {
+    resize(other.rows, other.columns);
+    if (data) memcpy(data, other.data, sizeof(float) * rows * stride);
+  }
+  return *this;
+}
+
+void matrix::resize(unsigned rows, unsigned columns) {
+  this->rows = rows;
+  this->columns = columns;
+  stride = (columns + ALIGNMENT_FLOATS - 1) / ALIGNMENT_FLOATS * ALIGNMENT_FLOATS;
+
+  size_t size = size_t(rows) * stride;
+  storage.reset(size ? new float[size + ALIGNMENT_FLOATS] : nullptr);
+  data = storage ? (float*)((uintptr_t(storage.get()) + ALIGNMENT - 1) & ~uintptr_t(ALIGNMENT - 1)) : nullptr;
+  if (data) memset(data, 0, sizeof(float) * size);
+}
+
+} // namespace parsito
+} // namespace ufal
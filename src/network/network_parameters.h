@@ -41,6 +41,7 @@ struct network_parameters {
   float l1_regularization;
   float l2_regularization;
   float maxnorm_regularization;
+  float activation_l1_regularization;
   float dropout_hidden, dropout_input;
   bool early_stopping;
 };
@@ -7,135 +7,385 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstring>
+#include <thread>
 
+#include "float16.h"
 #include "neural_network.h"
 
 namespace ufal {
 namespace parsito {
 
-void neural_network::load_matrix(binary_decoder& data, vector<vector<float>>& m) {
+void neural_network::load_matrix(binary_decoder& data, matrix& m) {
   unsigned rows = data.next_4B();
   unsigned columns = data.next_4B();
 
-  m.resize(rows);
-  for (auto&& row : m) {
-    row.resize(columns);
-    memcpy(row.data(), (const void*)data.next<float>(columns), sizeof(float) * columns);
-  }
+  m.resize(rows, columns);
+  for (unsigned i = 0; i < rows; i++)
+    memcpy(m[i], (const void*)data.next<float>(columns), sizeof(float) * columns);
 }
 
 void neural_network::load(binary_decoder& data) {
   hidden_layer_activation = activation_function::type(data.next_1B());
   load_matrix(data, weights[0]);
   load_matrix(data, weights[1]);
+
+  output_weights_transposed.resize(weights[1].columns, weights[1].rows - 1);
+  for (unsigned i = 0; i < weights[1].columns; i++)
+    for (unsigned j = 0; j + 1 < weights[1].rows; j++)
+      output_weights_transposed[i][j] = weights[1][j][i];
 }
 
 void neural_network::propagate(const vector<embedding>& embeddings, const vector<const vector<int>*>& embedding_ids_sequences,
-                               vector<float>& hidden_layer, vector<float>& outcomes, const embeddings_cache* cache, bool softmax) const {
+                               vector<float>& hidden_layer, vector<int8_t>& quantized_hidden_layer, vector<float>& outcomes,
+                               const embeddings_cache* cache, bool softmax) const {
+  const vector<const vector<int>*>* input = &embedding_ids_sequences;
+  propagate(embeddings, 1, &input, nullptr, hidden_layer, quantized_hidden_layer, outcomes, cache, softmax);
+}
+
+void neural_network::propagate_batch(const vector<embedding>& embeddings, const vector<const vector<const vector<int>*>*>& batch,
+                                     vector<float>& hidden_layers, vector<int8_t>& quantized_hidden_layer, vector<float>& outcomes,
+                                     const embeddings_cache* cache, bool softmax) const {
+  propagate(embeddings, batch.size(), batch.data(), nullptr, hidden_layers, quantized_hidden_layer, outcomes, cache, softmax);
+}
+
+void neural_network::propagate_batch_masked(const vector<embedding>& embeddings, const vector<const vector<const vector<int>*>*>& batch,
+                                            const vector<const vector<bool>*>& masks, vector<float>& hidden_layers,
+                                            vector<int8_t>& quantized_hidden_layer, vector<float>& outcomes,
+                                            const embeddings_cache* cache) const {
+  assert(masks.size() == batch.size());
+  propagate(embeddings, batch.size(), batch.data(), masks.data(), hidden_layers, quantized_hidden_layer, outcomes, cache, false);
+}
+
+void neural_network::propagate(const vector<embedding>& embeddings, unsigned count, const vector<const vector<int>*>* const* batch,
+                               const vector<bool>* const* masks, vector<float>& hidden_layers, vector<int8_t>& quantized_hidden_layer,
+                               vector<float>& outcomes, const embeddings_cache* cache, bool softmax) const {
   assert(!weights[0].empty());
   assert(!weights[1].empty());
-  for (auto&& embedding_ids : embedding_ids_sequences) if (embedding_ids) assert(embeddings.size() == embedding_ids->size());
-
-  unsigned hidden_layer_size = weights[0].front().size();
-  unsigned outcomes_size = weights[1].front().size();
-
-  outcomes.assign(outcomes_size, 0);
-
-  // Hidden layer
-  hidden_layer.assign(hidden_layer_size, 0);
-
-  unsigned index = 0;
-  for (unsigned sequence = 0; sequence < embedding_ids_sequences.size(); sequence++)
-    for (unsigned i = 0; i < embeddings.size(); index += embeddings[i].dimension, i++)
-      if (embedding_ids_sequences[sequence] && embedding_ids_sequences[sequence]->at(i) >= 0) {
-        unsigned word = embedding_ids_sequences[sequence]->at(i);
-        if (cache && i < cache->size() && word < cache->at(i).size()) {
-          // Use cache
-          const float* precomputed = cache->at(i)[word].data() + sequence * hidden_layer_size;
-          for (unsigned j = 0; j < hidden_layer_size; j++)
-            hidden_layer[j] += precomputed[j];
-        } else {
-          // Compute directly
-          const float* embedding = embeddings[i].weight(word);
-          for (unsigned j = 0; j < embeddings[i].dimension; j++)
-            for (unsigned k = 0; k < hidden_layer_size; k++)
-              hidden_layer[k] += embedding[j] * weights[0][index + j][k];
+
+  unsigned hidden_layer_size = weights[0].columns;
+  unsigned outcomes_size = weights[1].columns;
+
+  // Hidden layers
+  hidden_layers.assign(size_t(count) * hidden_layer_size, 0);
+  for (unsigned k = 0; k < count; k++) {
+    const vector<const vector<int>*>& embedding_ids_sequences = *batch[k];
+    float* hidden_layer = hidden_layers.data() + size_t(k) * hidden_layer_size;
+    for (auto&& embedding_ids : embedding_ids_sequences) if (embedding_ids) assert(embeddings.size() == embedding_ids->size());
+
+    unsigned index = 0;
+    for (unsigned sequence = 0; sequence < embedding_ids_sequences.size(); sequence++)
+      for (unsigned i = 0; i < embeddings.size(); index += embeddings[i].dimension, i++)
+        if (embedding_ids_sequences[sequence] && embedding_ids_sequences[sequence]->at(i) >= 0) {
+          unsigned word = embedding_ids_sequences[sequence]->at(i);
+          const char* row = nullptr;
+          if (cache && cache->contains(i, word)) {
+            row = cache->lazy ? cache->lazy_row(i, word) : cache->row(i, word);
+            if (!row && !cache->lazy_exhausted()) row = fill_lazy_embeddings_cache_row(embeddings, *cache, i, word);
+          }
+          if (row) {
+            // Use cache
+            switch (cache->precision) {
+              case embeddings_cache::FLOAT32:
+                kernels->add(hidden_layer_size, (const float*)row + sequence * hidden_layer_size, hidden_layer);
+                break;
+              case embeddings_cache::FLOAT16:
+                kernels->add_float16(hidden_layer_size, (const uint16_t*)row + sequence * hidden_layer_size, hidden_layer);
+                break;
+              case embeddings_cache::BFLOAT16:
+                kernels->add_bfloat16(hidden_layer_size, (const uint16_t*)row + sequence * hidden_layer_size, hidden_layer);
+                break;
+              case embeddings_cache::INT8:
+                kernels->add_int8(hidden_layer_size, ((const float*)row)[sequence],
+                                  (const int8_t*)(row + cache->sequences * sizeof(float)) + sequence * hidden_layer_size, hidden_layer);
+                break;
+            }
+          } else {
+            // Compute directly
+            kernels->gemv(embeddings[i].dimension, hidden_layer_size, embeddings[i].weight(word), weights[0][index], weights[0].stride, hidden_layer);
+          }
         }
-      }
-  for (unsigned i = 0; i < hidden_layer_size; i++) // Bias
-    hidden_layer[i] += weights[0][index][i];
+    kernels->add(hidden_layer_size, weights[0][index], hidden_layer); // Bias
+  }
 
-  // Activation function
+  // Activation function, applied to all hidden layers at once
+  size_t hidden_layers_size = size_t(count) * hidden_layer_size;
   switch (hidden_layer_activation) {
     case activation_function::TANH:
       if (!tanh_cache.empty())
-        for (auto&& weight : hidden_layer)
-          weight = weight <= -10 ? -1 : weight >= 10 ? 1 : tanh_cache[int(weight * 32768 + 10 * 32768)];
+        kernels->tanh(hidden_layers_size, tanh_cache.data(), hidden_layers.data());
       else
-        for (auto&& weight : hidden_layer)
+        for (auto&& weight : hidden_layers)
           weight = tanh(weight);
       break;
     case activation_function::CUBIC:
-      for (auto&& weight : hidden_layer)
-        weight = weight * weight * weight;
+      kernels->cubic(hidden_layers_size, hidden_layers.data());
       break;
     case activation_function::RELU:
-      for (auto&& weight : hidden_layer)
-        if (weight < 0) weight = 0;
+      kernels->relu(hidden_layers_size, hidden_layers.data());
       break;
   }
 
-  for (unsigned i = 0; i < hidden_layer_size; i++)
-    for (unsigned j = 0; j < outcomes_size; j++)
-      outcomes[j] += hidden_layer[i] * weights[1][i][j];
-  for (unsigned i = 0; i < outcomes_size; i++) // Bias
-    outcomes[i] += weights[1][hidden_layer_size][i];
+  // Output layer
+  bool masked = masks && !output_weights_transposed.empty();
+  if (quantized_weights.empty() && !masked && hidden_layer_activation != activation_function::RELU) {
+    // A single matrix product for the whole batch, so the weights are loaded once for several inputs
+    outcomes.assign(size_t(count) * outcomes_size, 0);
+    kernels->gemm(count, hidden_layer_size, outcomes_size, hidden_layers.data(), hidden_layer_size,
+                  weights[1][0], weights[1].stride, outcomes.data(), outcomes_size);
+  } else if (quantized_weights.empty()) {
+    // Either compute only the allowed outcomes, each using a single dot product,
+    // or skip the zero activations of a ReLU hidden layer, whichever is cheaper
+    outcomes.assign(size_t(count) * outcomes_size, 0);
+    for (unsigned k = 0; k < count; k++) {
+      const float* hidden_layer = hidden_layers.data() + size_t(k) * hidden_layer_size;
+      float* output = outcomes.data() + size_t(k) * outcomes_size;
 
-  // Softmax if requested
-  if (softmax) {
-    float max = outcomes[0];
-    for (unsigned i = 1; i < outcomes_size; i++) if (outcomes[i] > max) max = outcomes[i];
+      unsigned nonzero = hidden_layer_size;
+      if (hidden_layer_activation == activation_function::RELU) {
+        nonzero = 0;
+        for (unsigned i = 0; i < hidden_layer_size; i++) nonzero += hidden_layer[i] != 0;
+      }
+      unsigned allowed = outcomes_size;
+      if (masked) {
+        allowed = 0;
+        for (unsigned i = 0; i < outcomes_size; i++) allowed += (*masks[k])[i];
+      }
 
-    float sum = 0;
-    for (unsigned i = 0; i < outcomes_size; i++) sum += (outcomes[i] = exp(outcomes[i] - max));
-    sum = 1 / sum;
+      if (masked && size_t(allowed) * hidden_layer_size <= size_t(nonzero) * outcomes_size) {
+        for (unsigned i = 0; i < outcomes_size; i++)
+          if ((*masks[k])[i])
+            output[i] = kernels->dot(hidden_layer_size, hidden_layer, output_weights_transposed[i]);
+      } else {
+        kernels->gemv_sparse(hidden_layer_size, outcomes_size, hidden_layer, weights[1][0], weights[1].stride, output);
+      }
+    }
+  } else {
+    // Quantize the hidden layers one by one, padded by zero to an even number
+    // of rows as required by gemv_int8. All the outcomes are computed, which
+    // includes the outcomes allowed by the masks if any.
+    quantized_hidden_layer.assign((hidden_layer_size + 1) & ~1U, 0);
+    outcomes.assign(size_t(count) * outcomes_size, 0);
+    for (unsigned k = 0; k < count; k++) {
+      float hidden_layer_scale = kernels->quantize_int8(hidden_layer_size, hidden_layers.data() + size_t(k) * hidden_layer_size, quantized_hidden_layer.data());
+      kernels->gemv_int8(quantized_hidden_layer.size(), outcomes_size, quantized_hidden_layer.data(), hidden_layer_scale,
+                         quantized_weights.data(), quantized_stride, quantized_scales.data(), outcomes.data() + size_t(k) * outcomes_size);
+    }
+  }
+
+  for (unsigned k = 0; k < count; k++) {
+    float* output = outcomes.data() + size_t(k) * outcomes_size;
+    kernels->add(outcomes_size, weights[1][hidden_layer_size], output); // Bias
+
+    // Softmax if requested
+    if (softmax) {
+      float max = output[0];
+      for (unsigned i = 1; i < outcomes_size; i++) if (output[i] > max) max = output[i];
 
-    for (unsigned i = 0; i < outcomes_size; i++) outcomes[i] *= sum;
+      float sum = 0;
+      for (unsigned i = 0; i < outcomes_size; i++) sum += (output[i] = exp(output[i] - max));
+      sum = 1 / sum;
+
+      for (unsigned i = 0; i < outcomes_size; i++) output[i] *= sum;
+    }
   }
 }
 
 void neural_network::generate_tanh_cache() {
-  tanh_cache.resize(2 * 10 * 32768);
+  // The cache has one more element, because indices computed for values
+  // right below TANH_CACHE_RANGE can be rounded up to its size.
+  tanh_cache.resize(2 * vector_kernels::TANH_CACHE_RANGE * vector_kernels::TANH_CACHE_RESOLUTION + 1);
   for (unsigned i = 0; i < tanh_cache.size(); i++)
-    tanh_cache[i] = tanh(i / 32768.0 - 10);
+    tanh_cache[i] = tanh(i / double(vector_kernels::TANH_CACHE_RESOLUTION) - vector_kernels::TANH_CACHE_RANGE);
 }
 
-void neural_network::generate_embeddings_cache(const vector<embedding>& embeddings, embeddings_cache& cache, unsigned max_words) const {
+void neural_network::generate_embeddings_cache(const vector<embedding>& embeddings, embeddings_cache& cache, unsigned max_words,
+                                               embeddings_cache::precision_t precision, unsigned threads,
+                                               const embeddings_profile* profile, size_t max_memory) const {
   unsigned embeddings_dim = 0;
   for (auto&& embedding : embeddings) embeddings_dim += embedding.dimension;
 
-  unsigned sequences = weights[0].size() / embeddings_dim;
-  assert(sequences * embeddings_dim + 1 == weights[0].size());
+  unsigned sequences = weights[0].rows / embeddings_dim;
+  assert(sequences * embeddings_dim + 1 == weights[0].rows);
 
-  unsigned hidden_layer_size = weights[0].front().size();
+  unsigned hidden_layer_size = weights[0].columns;
 
-  cache.resize(embeddings.size());
-  for (unsigned i = 0, weight_index = 0; i < embeddings.size(); weight_index += embeddings[i].dimension, i++) {
-    unsigned words = 0;
-    while (words < max_words && embeddings[i].weight(words)) words++;
+  vector<unsigned> words(embeddings.size());
+  vector<vector<unsigned>> selected;
+  if (profile) {
+    for (unsigned i = 0; i < embeddings.size(); i++)
+      while (embeddings[i].weight(words[i])) words[i]++;
+
+    size_t row_size = embeddings_cache::row_size_for(precision, sequences, hidden_layer_size);
+    profile->select(max_words, max_memory ? max_memory / row_size : size_t(-1), selected);
+    selected.resize(embeddings.size());
+  } else {
+    for (unsigned i = 0; i < embeddings.size(); i++)
+      while (words[i] < max_words && embeddings[i].weight(words[i])) words[i]++;
+  }
+  cache.allocate(precision, sequences, hidden_layer_size, words, profile ? &selected : nullptr);
+
+  // Split the cached rows into blocks, which are processed by the given number of threads
+  enum { BLOCK_WORDS = 64 };
+  vector<pair<unsigned, unsigned>> blocks;
+  for (unsigned i = 0; i < embeddings.size(); i++)
+    for (unsigned row = 0; row < cache.tables[i].cached; row += BLOCK_WORDS)
+      blocks.emplace_back(i, row);
+
+  atomic<size_t> next_block(0);
+  auto process_blocks = [&]() {
+    vector<float> inputs, products;
+    for (size_t block; (block = next_block++) < blocks.size(); ) {
+      unsigned i = blocks[block].first, first_row = blocks[block].second;
+      unsigned block_words = min(unsigned(BLOCK_WORDS), cache.tables[i].cached - first_row);
+
+      unsigned weight_index = 0;
+      for (unsigned j = 0; j < i; j++) weight_index += embeddings[j].dimension;
 
-    cache[i].resize(words);
-    for (unsigned word = 0; word < words; word++) {
-      const float* embedding = embeddings[i].weight(word);
+      inputs.resize(block_words * embeddings[i].dimension);
+      for (unsigned word = 0; word < block_words; word++)
+        copy_n(embeddings[i].weight(profile ? selected[i][first_row + word] : first_row + word), embeddings[i].dimension,
+               inputs.data() + word * embeddings[i].dimension);
 
-      cache[i][word].assign(sequences * hidden_layer_size, 0);
+      // Multiply the embeddings of all words in the block by the weights of every sequence
+      products.assign(block_words * sequences * hidden_layer_size, 0);
       for (unsigned sequence = 0, index = weight_index; sequence < sequences; index += embeddings_dim, sequence++)
-        for (unsigned j = 0; j < embeddings[i].dimension; j++)
-          for (unsigned k = 0; k < hidden_layer_size; k++)
-            cache[i][word][sequence * hidden_layer_size + k] += embedding[j] * weights[0][index + j][k];
+        kernels->gemm(block_words, embeddings[i].dimension, hidden_layer_size, inputs.data(), embeddings[i].dimension,
+                      weights[0][index], weights[0].stride, products.data() + sequence * hidden_layer_size, sequences * hidden_layer_size);
+
+      for (unsigned word = 0; word < block_words; word++)
+        store_embeddings_cache_row(cache, products.data() + word * sequences * hidden_layer_size, cache.allocated_row(i, first_row + word));
     }
+  };
+
+  vector<thread> workers;
+  for (unsigned t = 1; t < threads && t < blocks.size(); t++)
+    workers.emplace_back(process_blocks);
+  process_blocks();
+  for (auto&& worker : workers)
+    worker.join();
+}
+
+void neural_network::generate_lazy_embeddings_cache(const vector<embedding>& embeddings, embeddings_cache& cache, unsigned max_words,
+                                                    embeddings_cache::precision_t precision, size_t max_memory) const {
+  unsigned embeddings_dim = 0;
+  for (auto&& embedding : embeddings) embeddings_dim += embedding.dimension;
+
+  unsigned sequences = weights[0].rows / embeddings_dim;
+  assert(sequences * embeddings_dim + 1 == weights[0].rows);
+
+  vector<unsigned> words(embeddings.size());
+  for (unsigned i = 0; i < embeddings.size(); i++)
+    while (words[i] < max_words && embeddings[i].weight(words[i])) words[i]++;
+  cache.allocate_lazy(precision, sequences, weights[0].columns, words, max_memory);
+}
+
+const char* neural_network::fill_lazy_embeddings_cache_row(const vector<embedding>& embeddings, const embeddings_cache& cache,
+                                                           unsigned embedding, unsigned word) const {
+  unsigned hidden_layer_size = cache.hidden_layer_size;
+  unsigned embeddings_dim = (weights[0].rows - 1) / cache.sequences;
+
+  unsigned weight_index = 0;
+  for (unsigned j = 0; j < embedding; j++) weight_index += embeddings[j].dimension;
+
+  // Compute the products without holding the cache lock
+  vector<float> products(cache.sequences * hidden_layer_size, 0);
+  for (unsigned sequence = 0, index = weight_index; sequence < cache.sequences; index += embeddings_dim, sequence++)
+    kernels->gemv(embeddings[embedding].dimension, hidden_layer_size, embeddings[embedding].weight(word), weights[0][index],
+                  weights[0].stride, products.data() + sequence * hidden_layer_size);
+
+  return cache.lazy_fill(embedding, word, [&cache, &products](char* row) {
+    store_embeddings_cache_row(cache, products.data(), row);
+  });
+}
+
+void neural_network::store_embeddings_cache_row(const embeddings_cache& cache, const float* products, char* row) {
+  unsigned size = cache.sequences * cache.hidden_layer_size;
+  size_t row_used = 0;
+
+  switch (cache.precision) {
+    case embeddings_cache::FLOAT32:
+      memcpy(row, products, size * sizeof(float));
+      row_used = size * sizeof(float);
+      break;
+    case embeddings_cache::FLOAT16:
+      for (unsigned j = 0; j < size; j++)
+        ((uint16_t*)row)[j] = float_to_float16(products[j]);
+      row_used = size * sizeof(uint16_t);
+      break;
+    case embeddings_cache::BFLOAT16:
+      for (unsigned j = 0; j < size; j++)
+        ((uint16_t*)row)[j] = float_to_bfloat16(products[j]);
+      row_used = size * sizeof(uint16_t);
+      break;
+    case embeddings_cache::INT8:
+      for (unsigned sequence = 0; sequence < cache.sequences; sequence++) {
+        const float* values = products + sequence * cache.hidden_layer_size;
+        int8_t* quantized = (int8_t*)(row + cache.sequences * sizeof(float)) + sequence * cache.hidden_layer_size;
+
+        float max = 0;
+        for (unsigned j = 0; j < cache.hidden_layer_size; j++) max = fmax(max, fabs(values[j]));
+        ((float*)row)[sequence] = max / 127;
+        for (unsigned j = 0; j < cache.hidden_layer_size; j++) quantized[j] = max ? int8_t(lrint(values[j] * 127 / max)) : 0;
+      }
+      row_used = cache.sequences * sizeof(float) + size;
+      break;
+  }
+
+  // Clear the padding, so that the rows are fully initialized
+  memset(row + row_used, 0, cache.row_size - row_used);
+}
+
+uint64_t neural_network::fingerprint(const vector<embedding>& embeddings) const {
+  // FNV-1a hash of the dimensions of the hidden layer weights and the embeddings,
+  // and of a sample of their rows, so that it is fast even for large embeddings.
+  // The sampled rows are evenly spaced, including the first and the last one.
+  enum { SAMPLED_ROWS = 64 };
+  auto sampled_row = [](unsigned sample, unsigned rows) {
+    return rows <= SAMPLED_ROWS ? sample : unsigned(uint64_t(sample) * (rows - 1) / (SAMPLED_ROWS - 1));
+  };
+
+  uint64_t hash = 14695981039346656037ULL;
+  auto add = [&hash](const void* data, size_t size) {
+    for (size_t i = 0; i < size; i++)
+      hash = (hash ^ ((const unsigned char*)data)[i]) * 1099511628211ULL;
+  };
+
+  add(&weights[0].rows, sizeof(weights[0].rows));
+  add(&weights[0].columns, sizeof(weights[0].columns));
+  for (unsigned i = 0; i < min(weights[0].rows, unsigned(SAMPLED_ROWS)); i++)
+    add(weights[0][sampled_row(i, weights[0].rows)], weights[0].columns * sizeof(float));
+  for (auto&& embedding : embeddings) {
+    unsigned words = 0;
+    while (embedding.weight(words)) words++;
+
+    add(&embedding.dimension, sizeof(embedding.dimension));
+    add(&words, sizeof(words));
+    for (unsigned i = 0; i < min(words, unsigned(SAMPLED_ROWS)); i++)
+      add(embedding.weight(sampled_row(i, words)), embedding.dimension * sizeof(float));
+  }
+  return hash;
+}
+
+void neural_network::quantize() {
+  unsigned hidden_layer_size = weights[1].rows - 1;
+  unsigned outcomes_size = weights[1].columns;
+
+  // The rows are stored interleaved in pairs, as required by gemv_int8
+  quantized_stride = weights[1].stride;
+  quantized_weights.assign(size_t((hidden_layer_size + 1) & ~1U) * quantized_stride, 0);
+  quantized_scales.assign(quantized_stride, 0);
+
+  for (unsigned i = 0; i < outcomes_size; i++) {
+    float max = 0;
+    for (unsigned j = 0; j < hidden_layer_size; j++) max = fmax(max, fabs(weights[1][j][i]));
+
+    quantized_scales[i] = max / 127;
+    for (unsigned j = 0; max && j < hidden_layer_size; j++)
+      quantized_weights[size_t(j / 2) * 2 * quantized_stride + 2 * i + j % 2] = int8_t(lrint(weights[1][j][i] * 127 / max));
   }
 }
 
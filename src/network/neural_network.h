@@ -12,31 +12,83 @@
 #include "common.h"
 #include "activation_function.h"
 #include "embedding/embedding.h"
+#include "embeddings_cache.h"
+#include "embeddings_profile.h"
+#include "matrix.h"
 #include "utils/binary_decoder.h"
+#include "vector_kernels.h"
 
 namespace ufal {
 namespace parsito {
 
 class neural_network {
  public:
-  typedef vector<vector<vector<float>>> embeddings_cache;
+  typedef parsito::embeddings_cache embeddings_cache;
+  typedef parsito::embeddings_profile embeddings_profile;
 
+  // The quantized_hidden_layer is a buffer used only by a quantized network.
   void propagate(const vector<embedding>& embeddings, const vector<const vector<int>*>& embedding_ids_sequences,
-                 vector<float>& hidden_layer, vector<float>& outcomes, const embeddings_cache* cache = nullptr, bool softmax = true) const;
+                 vector<float>& hidden_layer, vector<int8_t>& quantized_hidden_layer, vector<float>& outcomes,
+                 const embeddings_cache* cache = nullptr, bool softmax = true) const;
+  // Propagate a batch of inputs, storing the outcomes of the k-th input at
+  // outcomes[k * outcomes_size]. The output layer is computed using a single
+  // matrix product, which is faster than propagating the inputs separately.
+  void propagate_batch(const vector<embedding>& embeddings, const vector<const vector<const vector<int>*>*>& batch,
+                       vector<float>& hidden_layers, vector<int8_t>& quantized_hidden_layer, vector<float>& outcomes,
+                       const embeddings_cache* cache = nullptr, bool softmax = true) const;
+  // Propagate a batch of inputs without softmax, computing only the outcomes
+  // allowed by the mask of every input; the other outcomes are unspecified.
+  // A quantized network computes all the outcomes.
+  void propagate_batch_masked(const vector<embedding>& embeddings, const vector<const vector<const vector<int>*>*>& batch,
+                              const vector<const vector<bool>*>& masks, vector<float>& hidden_layers,
+                              vector<int8_t>& quantized_hidden_layer, vector<float>& outcomes,
+                              const embeddings_cache* cache = nullptr) const;
 
   void load(binary_decoder& data);
   void generate_tanh_cache();
-  void generate_embeddings_cache(const vector<embedding>& embeddings, embeddings_cache& cache, unsigned max_words) const;
+  // If a profile is given, the most frequent profiled words are cached
+  // instead of the first ones, using at most max_memory bytes if nonzero.
+  void generate_embeddings_cache(const vector<embedding>& embeddings, embeddings_cache& cache, unsigned max_words,
+                                 embeddings_cache::precision_t precision = embeddings_cache::FLOAT32, unsigned threads = 1,
+                                 const embeddings_profile* profile = nullptr, size_t max_memory = 0) const;
+  // Prepare a lazy embeddings cache, whose rows are computed by propagate on first use.
+  void generate_lazy_embeddings_cache(const vector<embedding>& embeddings, embeddings_cache& cache, unsigned max_words,
+                                      embeddings_cache::precision_t precision, size_t max_memory) const;
+
+  // Quantize the output layer to int8, which is then used by propagate.
+  void quantize();
+
+  // Fingerprint of the network and the given embeddings, used to verify
+  // that a cache file belongs to them.
+  uint64_t fingerprint(const vector<embedding>& embeddings) const;
 
  private:
   friend class neural_network_trainer;
 
-  void load_matrix(binary_decoder& data, vector<vector<float>>& m);
+  void load_matrix(binary_decoder& data, matrix& m);
+  void propagate(const vector<embedding>& embeddings, unsigned count, const vector<const vector<int>*>* const* batch,
+                 const vector<bool>* const* masks, vector<float>& hidden_layers, vector<int8_t>& quantized_hidden_layer,
+                 vector<float>& outcomes, const embeddings_cache* cache, bool softmax) const;
+  static void store_embeddings_cache_row(const embeddings_cache& cache, const float* products, char* row);
+  const char* fill_lazy_embeddings_cache_row(const vector<embedding>& embeddings, const embeddings_cache& cache, unsigned embedding, unsigned word) const;
 
   activation_function::type hidden_layer_activation;
-  vector<vector<float>> weights[2];
+  matrix weights[2];
+
+  // Output layer weights without the bias, transposed so that every outcome
+  // is a dot product of the hidden layer and a row; used by masked propagation.
+  matrix output_weights_transposed;
 
   vector<float> tanh_cache;
+
+  // Quantized output layer: int8 weights[1] without the bias, with pairs of rows
+  // interleaved as required by vector_kernels::gemv_int8, and with a separate
+  // scale for every outcome.
+  vector<int8_t> quantized_weights;
+  vector<float> quantized_scales;
+  unsigned quantized_stride = 0;
+
+  const vector_kernels* kernels = &vector_kernels::best();
 };
 
 } // namespace parsito
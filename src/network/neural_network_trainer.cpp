@@ -21,23 +21,19 @@ neural_network_trainer::neural_network_trainer(neural_network& network, unsigned
         -parameters.initialization_range * sqrt(6.0 / float(input_size + parameters.hidden_layer));
     uniform_real_distribution<float> uniform_pre_hidden(-uniform_pre_hidden_range, uniform_pre_hidden_range);
 
-    network.weights[0].resize(input_size + 1/*bias*/);
-    for (auto&& row : network.weights[0]) {
-      row.resize(parameters.hidden_layer);
-      for (auto&& weight : row)
-        weight = uniform_pre_hidden(generator);
-    }
+    network.weights[0].resize(input_size + 1/*bias*/, parameters.hidden_layer);
+    for (unsigned i = 0; i < network.weights[0].rows; i++)
+      for (unsigned j = 0; j < network.weights[0].columns; j++)
+        network.weights[0][i][j] = uniform_pre_hidden(generator);
 
     float uniform_post_hidden_range = parameters.initialization_range > 0 ? parameters.initialization_range :
         -parameters.initialization_range * sqrt(6.0 / float(output_size + parameters.hidden_layer));
     uniform_real_distribution<float> uniform_post_hidden(-uniform_post_hidden_range, uniform_post_hidden_range);
 
-    network.weights[1].resize(parameters.hidden_layer + 1/*bias*/);
-    for (auto&& row : network.weights[1]) {
-      row.resize(output_size);
-      for (auto&& weight : row)
-        weight = uniform_post_hidden(generator);
-    }
+    network.weights[1].resize(parameters.hidden_layer + 1/*bias*/, output_size);
+    for (unsigned i = 0; i < network.weights[1].rows; i++)
+      for (unsigned j = 0; j < network.weights[1].columns; j++)
+        network.weights[1][i][j] = uniform_post_hidden(generator);
   }
 
   // Store the network_parameters
@@ -48,6 +44,7 @@ neural_network_trainer::neural_network_trainer(neural_network& network, unsigned
   l1_regularization = parameters.l1_regularization;
   l2_regularization = parameters.l2_regularization;
   maxnorm_regularization = parameters.maxnorm_regularization;
+  activation_l1_regularization = parameters.activation_l1_regularization;
   dropout_hidden = parameters.dropout_hidden;
   dropout_input = parameters.dropout_input;
 
@@ -69,26 +66,26 @@ bool neural_network_trainer::next_iteration() {
 void neural_network_trainer::propagate(const vector<embedding>& embeddings, const vector<const vector<int>*>& embedding_ids_sequences, workspace& w) const {
   // Initialize dropout if requested
   if (dropout_input) {
-    w.input_dropout.resize(network.weights[0].size());
+    w.input_dropout.resize(network.weights[0].rows);
     bernoulli_distribution dropout(dropout_input);
     for (auto&& flag : w.input_dropout)
       flag = dropout(generator);
   }
 
   if (dropout_hidden) {
-    w.hidden_dropout.resize(network.weights[1].size());
+    w.hidden_dropout.resize(network.weights[1].rows);
     bernoulli_distribution dropout(dropout_hidden);
     for (auto&& flag : w.hidden_dropout)
       flag = dropout(generator);
   }
   w.hidden_kept.clear();
-  for (unsigned i = 0; i < network.weights[0].front().size(); i++)
+  for (unsigned i = 0; i < network.weights[0].columns; i++)
     if (w.hidden_dropout.empty() || !w.hidden_dropout[i])
       w.hidden_kept.push_back(i);
 
   // Propagate
-  unsigned hidden_layer_size = network.weights[0].front().size();
-  unsigned outcomes_size = network.weights[1].front().size();
+  unsigned hidden_layer_size = network.weights[0].columns;
+  unsigned outcomes_size = network.weights[1].columns;
 
   w.outcomes.assign(outcomes_size, 0);
 
@@ -197,20 +194,20 @@ float neural_network_trainer::trainer_adam::delta(float gradient, const network_
 // Backpropagation
 template <class TRAINER>
 void neural_network_trainer::backpropagate_template(vector<embedding>& embeddings, const vector<const vector<int>*>& embedding_ids_sequences, unsigned required_outcome, workspace& w) {
-  size_t hidden_layer_size = network.weights[0].front().size();
-  size_t outcomes_size = network.weights[1].front().size();
+  size_t hidden_layer_size = network.weights[0].columns;
+  size_t outcomes_size = network.weights[1].columns;
 
   // Allocate space for delta accumulators
-  if (network.weights[0].size() > w.weights_batch[0].size()) w.weights_batch[0].resize(network.weights[0].size());
-  if (network.weights[1].size() > w.weights_batch[1].size()) w.weights_batch[1].resize(network.weights[1].size());
+  if (network.weights[0].rows > w.weights_batch[0].size()) w.weights_batch[0].resize(network.weights[0].rows);
+  if (network.weights[1].rows > w.weights_batch[1].size()) w.weights_batch[1].resize(network.weights[1].rows);
   if (embeddings.size() > w.error_embedding.size()) w.error_embedding.resize(embeddings.size());
   if (embeddings.size() > w.error_embedding_nonempty.size()) w.error_embedding_nonempty.resize(embeddings.size());
 
   // Allocate space for trainer_data if required)
   workspace::trainer_data none_trainer_data;
   if (TRAINER::need_trainer_data) {
-    while (network.weights[0].size() > w.weights_trainer[0].size()) w.weights_trainer[0].emplace_back(network.weights[0].front().size());
-    while (network.weights[1].size() > w.weights_trainer[1].size()) w.weights_trainer[1].emplace_back(outcomes_size);
+    while (network.weights[0].rows > w.weights_trainer[0].size()) w.weights_trainer[0].emplace_back(hidden_layer_size);
+    while (network.weights[1].rows > w.weights_trainer[1].size()) w.weights_trainer[1].emplace_back(outcomes_size);
   }
 
   // Compute error vector
@@ -230,6 +227,11 @@ void neural_network_trainer::backpropagate_template(vector<embedding>& embedding
       w.error_hidden[i] *= dropout_factor;
   }
 
+  // L1 regularization of the hidden layer activations, which makes them sparser
+  if (activation_l1_regularization)
+    for (auto&& i : w.hidden_kept)
+      if (w.hidden_layer[i]) w.error_hidden[i] -= w.hidden_layer[i] > 0 ? activation_l1_regularization : -activation_l1_regularization;
+
   // Perform activation function derivation
   switch (network.hidden_layer_activation) {
     case activation_function::TANH:
@@ -374,28 +376,28 @@ void neural_network_trainer::l1_regularize() {
   if (!l1_regularization) return;
 
   for (auto&& weights : network.weights)
-    for (unsigned i = 0; i + 1 /*ignore biases*/ < weights.size(); i++) {
-      auto& row = weights[i];
-      for (auto&& weight : row)
+    for (unsigned i = 0; i + 1 /*ignore biases*/ < weights.rows; i++)
+      for (unsigned j = 0; j < weights.columns; j++) {
+        float& weight = weights[i][j];
         if (weight < l1_regularization) weight += l1_regularization;
         else if (weight > l1_regularization) weight -= l1_regularization;
         else weight = 0;
-    }
+      }
 }
 
 void neural_network_trainer::maxnorm_regularize() {
   if (!maxnorm_regularization) return;
 
   for (unsigned i = 0; i < 2; i++)
-    for (unsigned j = 0; j < network.weights[i].front().size(); j++) {
+    for (unsigned j = 0; j < network.weights[i].columns; j++) {
       float length = 0;
-      for (auto&& row : network.weights[i])
-        length += row[j] * row[j];
+      for (unsigned k = 0; k < network.weights[i].rows; k++)
+        length += network.weights[i][k][j] * network.weights[i][k][j];
 
       if (length > 0 && length > maxnorm_regularization * maxnorm_regularization) {
         float factor = 1 / sqrt(length / (maxnorm_regularization * maxnorm_regularization));
-        for (auto&& row : network.weights[i])
-          row[j] *= factor;
+        for (unsigned k = 0; k < network.weights[i].rows; k++)
+          network.weights[i][k][j] *= factor;
       }
     }
 }
@@ -404,14 +406,12 @@ void neural_network_trainer::finalize_sentence() {
   if (l1_regularization) l1_regularize();
 }
 
-void neural_network_trainer::save_matrix(const vector<vector<float>>& m, binary_encoder& enc) const {
-  enc.add_4B(m.size());
-  enc.add_4B(m.empty() ? 0 : m.front().size());
+void neural_network_trainer::save_matrix(const matrix& m, binary_encoder& enc) const {
+  enc.add_4B(m.rows);
+  enc.add_4B(m.columns);
 
-  for (auto&& row : m) {
-    assert(row.size() == m.front().size());
-    enc.add_data(row);
-  }
+  for (unsigned i = 0; i < m.rows; i++)
+    enc.add_data(m[i], m.columns);
 }
 
 void neural_network_trainer::save_network(binary_encoder& enc) const {
@@ -84,7 +84,7 @@ class neural_network_trainer {
   void l1_regularize();
   void maxnorm_regularize();
 
-  void save_matrix(const vector<vector<float>>& m, binary_encoder& enc) const;
+  void save_matrix(const matrix& m, binary_encoder& enc) const;
 
   neural_network& network;
   mt19937& generator;
@@ -92,6 +92,7 @@ class neural_network_trainer {
   network_trainer trainer;
   unsigned batch_size;
   float l1_regularization, l2_regularization, maxnorm_regularization;
+  float activation_l1_regularization;
   float dropout_hidden, dropout_input;
 };
 
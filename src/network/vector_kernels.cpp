@@ -0,0 +1,831 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#include "float16.h"
+#include "vector_kernels.h"
+
+namespace ufal {
+namespace parsito {
+
+// Generic implementation
+static void add_generic(unsigned n, const float* x, float* y) {
+  for (unsigned i = 0; i < n; i++)
+    y[i] += x[i];
+}
+
+static void gemv_generic(unsigned rows, unsigned n, const float* x, const float* m, size_t stride, float* y) {
+  for (unsigned r = 0; r < rows; r++, m += stride)
+    for (unsigned i = 0; i < n; i++)
+      y[i] += x[r] * m[i];
+}
+
+static void gemm_generic(unsigned count, unsigned rows, unsigned n, const float* x, size_t x_stride, const float* m, size_t stride, float* y, size_t y_stride) {
+  for (unsigned k = 0; k < count; k++)
+    gemv_generic(rows, n, x + k * x_stride, m, stride, y + k * y_stride);
+}
+
+// Sparse gemv implementations gather the rows with nonzero x in chunks of
+// SPARSE_CHUNK rows, which are then processed in the same order as in gemv.
+enum { SPARSE_CHUNK = 256 };
+
+static unsigned gather_nonzero(unsigned start, unsigned rows, const float* x, unsigned* nonzero) {
+  unsigned count = 0;
+  for (unsigned r = start; r < rows && r < start + SPARSE_CHUNK; r++)
+    nonzero[count] = r, count += x[r] != 0;
+  return count;
+}
+
+static void gemv_rows_generic(unsigned count, const unsigned* nonzero, unsigned n, const float* x, const float* m, size_t stride, float* y) {
+  for (unsigned k = 0; k < count; k++)
+    for (unsigned i = 0; i < n; i++)
+      y[i] += x[nonzero[k]] * m[nonzero[k] * stride + i];
+}
+
+static void gemv_sparse_generic(unsigned rows, unsigned n, const float* x, const float* m, size_t stride, float* y) {
+  unsigned nonzero[SPARSE_CHUNK];
+  for (unsigned start = 0; start < rows; start += SPARSE_CHUNK)
+    gemv_rows_generic(gather_nonzero(start, rows, x, nonzero), nonzero, n, x, m, stride, y);
+}
+
+static float dot_generic(unsigned n, const float* x, const float* y) {
+  float sum = 0;
+  for (unsigned i = 0; i < n; i++)
+    sum += x[i] * y[i];
+  return sum;
+}
+
+static void add_float16_generic(unsigned n, const uint16_t* x, float* y) {
+  for (unsigned i = 0; i < n; i++)
+    y[i] += float16_to_float(x[i]);
+}
+
+static void add_bfloat16_generic(unsigned n, const uint16_t* x, float* y) {
+  for (unsigned i = 0; i < n; i++)
+    y[i] += bfloat16_to_float(x[i]);
+}
+
+static void add_int8_generic(unsigned n, float scale, const int8_t* x, float* y) {
+  for (unsigned i = 0; i < n; i++)
+    y[i] += scale * x[i];
+}
+
+static float quantize_int8_generic(unsigned n, const float* x, int8_t* q) {
+  float max = 0;
+  for (unsigned i = 0; i < n; i++)
+    if (fabs(x[i]) > max) max = fabs(x[i]);
+
+  float inverse = max ? 127 / max : 0;
+  for (unsigned i = 0; i < n; i++)
+    q[i] = int8_t(lrint(x[i] * inverse));
+  return max / 127;
+}
+
+static void gemv_int8_generic(unsigned rows, unsigned n, const int8_t* x, float x_scale, const int8_t* m, size_t stride, const float* m_scales, float* y) {
+  for (unsigned i = 0; i < n; i++) {
+    int32_t sum = 0;
+    for (unsigned r = 0; r < rows; r += 2)
+      sum += int32_t(x[r]) * int32_t(m[r * stride + 2 * i]) + int32_t(x[r + 1]) * int32_t(m[r * stride + 2 * i + 1]);
+    y[i] += x_scale * m_scales[i] * sum;
+  }
+}
+
+static inline float tanh_cached(float x, const float* tanh_cache) {
+  return x <= -vector_kernels::TANH_CACHE_RANGE ? -1 : x >= vector_kernels::TANH_CACHE_RANGE ? 1 :
+      tanh_cache[int(x * vector_kernels::TANH_CACHE_RESOLUTION + vector_kernels::TANH_CACHE_RANGE * vector_kernels::TANH_CACHE_RESOLUTION)];
+}
+
+static void tanh_generic(unsigned n, const float* tanh_cache, float* x) {
+  for (unsigned i = 0; i < n; i++)
+    x[i] = tanh_cached(x[i], tanh_cache);
+}
+
+static void cubic_generic(unsigned n, float* x) {
+  for (unsigned i = 0; i < n; i++)
+    x[i] = x[i] * x[i] * x[i];
+}
+
+static void relu_generic(unsigned n, float* x) {
+  for (unsigned i = 0; i < n; i++)
+    if (x[i] < 0) x[i] = 0;
+}
+
+static const vector_kernels kernels_generic = {
+  "generic", add_generic, gemv_generic, gemm_generic, gemv_sparse_generic, dot_generic, add_float16_generic, add_bfloat16_generic,
+  add_int8_generic, quantize_int8_generic, gemv_int8_generic, tanh_generic, cubic_generic, relu_generic
+};
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#if defined(_MSC_VER)
+#define PARSITO_TARGET_AVX2
+#define PARSITO_TARGET_AVX512
+#else
+#define PARSITO_TARGET_AVX2 __attribute__((target("avx,avx2,fma,f16c")))
+#define PARSITO_TARGET_AVX512 __attribute__((target("avx,avx2,fma,f16c,avx512f,avx512bw")))
+#endif
+
+// SSE2 implementation
+static void add_sse2(unsigned n, const float* x, float* y) {
+  unsigned i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_loadu_ps(x + i)));
+  for (; i < n; i++)
+    y[i] += x[i];
+}
+
+static void gemv_sse2(unsigned rows, unsigned n, const float* x, const float* m, size_t stride, float* y) {
+  unsigned i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128 y0 = _mm_loadu_ps(y + i), y1 = _mm_loadu_ps(y + i + 4), y2 = _mm_loadu_ps(y + i + 8), y3 = _mm_loadu_ps(y + i + 12);
+    const float* row = m + i;
+    for (unsigned r = 0; r < rows; r++, row += stride) {
+      __m128 xr = _mm_set1_ps(x[r]);
+      y0 = _mm_add_ps(y0, _mm_mul_ps(xr, _mm_loadu_ps(row)));
+      y1 = _mm_add_ps(y1, _mm_mul_ps(xr, _mm_loadu_ps(row + 4)));
+      y2 = _mm_add_ps(y2, _mm_mul_ps(xr, _mm_loadu_ps(row + 8)));
+      y3 = _mm_add_ps(y3, _mm_mul_ps(xr, _mm_loadu_ps(row + 12)));
+    }
+    _mm_storeu_ps(y + i, y0); _mm_storeu_ps(y + i + 4, y1); _mm_storeu_ps(y + i + 8, y2); _mm_storeu_ps(y + i + 12, y3);
+  }
+  for (; i + 4 <= n; i += 4) {
+    __m128 y0 = _mm_loadu_ps(y + i);
+    const float* row = m + i;
+    for (unsigned r = 0; r < rows; r++, row += stride)
+      y0 = _mm_add_ps(y0, _mm_mul_ps(_mm_set1_ps(x[r]), _mm_loadu_ps(row)));
+    _mm_storeu_ps(y + i, y0);
+  }
+  if (i < n)
+    gemv_generic(rows, n - i, x, m + i, stride, y + i);
+}
+
+static void gemm_sse2(unsigned count, unsigned rows, unsigned n, const float* x, size_t x_stride, const float* m, size_t stride, float* y, size_t y_stride) {
+  // Four outputs at a time share the loaded matrix rows
+  unsigned k = 0;
+  for (; k + 4 <= count; k += 4, x += 4 * x_stride, y += 4 * y_stride) {
+    const float *x0 = x, *x1 = x + x_stride, *x2 = x + 2 * x_stride, *x3 = x + 3 * x_stride;
+    float *y0 = y, *y1 = y + y_stride, *y2 = y + 2 * y_stride, *y3 = y + 3 * y_stride;
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m128 a0 = _mm_loadu_ps(y0 + i), b0 = _mm_loadu_ps(y0 + i + 4), a1 = _mm_loadu_ps(y1 + i), b1 = _mm_loadu_ps(y1 + i + 4);
+      __m128 a2 = _mm_loadu_ps(y2 + i), b2 = _mm_loadu_ps(y2 + i + 4), a3 = _mm_loadu_ps(y3 + i), b3 = _mm_loadu_ps(y3 + i + 4);
+      const float* row = m + i;
+      for (unsigned r = 0; r < rows; r++, row += stride) {
+        __m128 ma = _mm_loadu_ps(row), mb = _mm_loadu_ps(row + 4), xr;
+        xr = _mm_set1_ps(x0[r]); a0 = _mm_add_ps(a0, _mm_mul_ps(xr, ma)); b0 = _mm_add_ps(b0, _mm_mul_ps(xr, mb));
+        xr = _mm_set1_ps(x1[r]); a1 = _mm_add_ps(a1, _mm_mul_ps(xr, ma)); b1 = _mm_add_ps(b1, _mm_mul_ps(xr, mb));
+        xr = _mm_set1_ps(x2[r]); a2 = _mm_add_ps(a2, _mm_mul_ps(xr, ma)); b2 = _mm_add_ps(b2, _mm_mul_ps(xr, mb));
+        xr = _mm_set1_ps(x3[r]); a3 = _mm_add_ps(a3, _mm_mul_ps(xr, ma)); b3 = _mm_add_ps(b3, _mm_mul_ps(xr, mb));
+      }
+      _mm_storeu_ps(y0 + i, a0); _mm_storeu_ps(y0 + i + 4, b0); _mm_storeu_ps(y1 + i, a1); _mm_storeu_ps(y1 + i + 4, b1);
+      _mm_storeu_ps(y2 + i, a2); _mm_storeu_ps(y2 + i + 4, b2); _mm_storeu_ps(y3 + i, a3); _mm_storeu_ps(y3 + i + 4, b3);
+    }
+    if (i < n)
+      for (unsigned j = 0; j < 4; j++)
+        gemv_sse2(rows, n - i, x + j * x_stride, m + i, stride, y + j * y_stride + i);
+  }
+  for (; k < count; k++, x += x_stride, y += y_stride)
+    gemv_sse2(rows, n, x, m, stride, y);
+}
+
+static void gemv_sparse_sse2(unsigned rows, unsigned n, const float* x, const float* m, size_t stride, float* y) {
+  unsigned nonzero[SPARSE_CHUNK];
+  for (unsigned start = 0; start < rows; start += SPARSE_CHUNK) {
+    unsigned count = gather_nonzero(start, rows, x, nonzero);
+    unsigned i = 0;
+    for (; i + 16 <= n; i += 16) {
+      __m128 y0 = _mm_loadu_ps(y + i), y1 = _mm_loadu_ps(y + i + 4), y2 = _mm_loadu_ps(y + i + 8), y3 = _mm_loadu_ps(y + i + 12);
+      for (unsigned k = 0; k < count; k++) {
+        const float* row = m + nonzero[k] * stride + i;
+        __m128 xr = _mm_set1_ps(x[nonzero[k]]);
+        y0 = _mm_add_ps(y0, _mm_mul_ps(xr, _mm_loadu_ps(row)));
+        y1 = _mm_add_ps(y1, _mm_mul_ps(xr, _mm_loadu_ps(row + 4)));
+        y2 = _mm_add_ps(y2, _mm_mul_ps(xr, _mm_loadu_ps(row + 8)));
+        y3 = _mm_add_ps(y3, _mm_mul_ps(xr, _mm_loadu_ps(row + 12)));
+      }
+      _mm_storeu_ps(y + i, y0); _mm_storeu_ps(y + i + 4, y1); _mm_storeu_ps(y + i + 8, y2); _mm_storeu_ps(y + i + 12, y3);
+    }
+    for (; i + 4 <= n; i += 4) {
+      __m128 y0 = _mm_loadu_ps(y + i);
+      for (unsigned k = 0; k < count; k++)
+        y0 = _mm_add_ps(y0, _mm_mul_ps(_mm_set1_ps(x[nonzero[k]]), _mm_loadu_ps(m + nonzero[k] * stride + i)));
+      _mm_storeu_ps(y + i, y0);
+    }
+    if (i < n)
+      gemv_rows_generic(count, nonzero, n - i, x, m + i, stride, y + i);
+  }
+}
+
+static float dot_sse2(unsigned n, const float* x, const float* y) {
+  __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+  unsigned i = 0;
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+    s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(y + i + 4)));
+  }
+  float sums[4];
+  _mm_storeu_ps(sums, _mm_add_ps(s0, s1));
+  return (sums[0] + sums[1]) + (sums[2] + sums[3]) + dot_generic(n - i, x + i, y + i);
+}
+
+static void add_bfloat16_sse2(unsigned n, const uint16_t* x, float* y) {
+  const __m128i zero = _mm_setzero_si128();
+  unsigned i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(x + i));
+    _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_castsi128_ps(_mm_unpacklo_epi16(zero, v))));
+    _mm_storeu_ps(y + i + 4, _mm_add_ps(_mm_loadu_ps(y + i + 4), _mm_castsi128_ps(_mm_unpackhi_epi16(zero, v))));
+  }
+  add_bfloat16_generic(n - i, x + i, y + i);
+}
+
+static void add_int8_sse2(unsigned n, float scale, const int8_t* x, float* y) {
+  const __m128 s = _mm_set1_ps(scale);
+  unsigned i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(x + i));
+    __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8), hi = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+    __m128i v0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16), v1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16);
+    __m128i v2 = _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16), v3 = _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16);
+    _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(s, _mm_cvtepi32_ps(v0))));
+    _mm_storeu_ps(y + i + 4, _mm_add_ps(_mm_loadu_ps(y + i + 4), _mm_mul_ps(s, _mm_cvtepi32_ps(v1))));
+    _mm_storeu_ps(y + i + 8, _mm_add_ps(_mm_loadu_ps(y + i + 8), _mm_mul_ps(s, _mm_cvtepi32_ps(v2))));
+    _mm_storeu_ps(y + i + 12, _mm_add_ps(_mm_loadu_ps(y + i + 12), _mm_mul_ps(s, _mm_cvtepi32_ps(v3))));
+  }
+  add_int8_generic(n - i, scale, x + i, y + i);
+}
+
+static float quantize_int8_sse2(unsigned n, const float* x, int8_t* q) {
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128 max4 = _mm_setzero_ps();
+  unsigned i = 0;
+  for (; i + 4 <= n; i += 4)
+    max4 = _mm_max_ps(max4, _mm_and_ps(_mm_loadu_ps(x + i), abs_mask));
+  max4 = _mm_max_ps(max4, _mm_shuffle_ps(max4, max4, _MM_SHUFFLE(1, 0, 3, 2)));
+  max4 = _mm_max_ps(max4, _mm_shuffle_ps(max4, max4, _MM_SHUFFLE(2, 3, 0, 1)));
+  float max = _mm_cvtss_f32(max4);
+  for (; i < n; i++)
+    if (fabs(x[i]) > max) max = fabs(x[i]);
+
+  float inverse = max ? 127 / max : 0;
+  const __m128 inverse4 = _mm_set1_ps(inverse);
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m128i v = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(x + i), inverse4));
+    v = _mm_packs_epi16(_mm_packs_epi32(v, v), v);
+    int32_t packed = _mm_cvtsi128_si32(v);
+    memcpy(q + i, &packed, 4);
+  }
+  for (; i < n; i++)
+    q[i] = int8_t(lrint(x[i] * inverse));
+  return max / 127;
+}
+
+static void gemv_int8_sse2(unsigned rows, unsigned n, const int8_t* x, float x_scale, const int8_t* m, size_t stride, const float* m_scales, float* y) {
+  const __m128 s = _mm_set1_ps(x_scale);
+  unsigned i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i sum0 = _mm_setzero_si128(), sum1 = _mm_setzero_si128();
+    const int8_t* row = m + 2 * i;
+    for (unsigned r = 0; r < rows; r += 2, row += 2 * stride) {
+      __m128i xr = _mm_set1_epi32(int32_t(uint16_t(int16_t(x[r]))) | (int32_t(x[r + 1]) << 16));
+      __m128i v = _mm_loadu_si128((const __m128i*)row);
+      sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8), xr));
+      sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8), xr));
+    }
+    _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(_mm_mul_ps(s, _mm_loadu_ps(m_scales + i)), _mm_cvtepi32_ps(sum0))));
+    _mm_storeu_ps(y + i + 4, _mm_add_ps(_mm_loadu_ps(y + i + 4), _mm_mul_ps(_mm_mul_ps(s, _mm_loadu_ps(m_scales + i + 4)), _mm_cvtepi32_ps(sum1))));
+  }
+  if (i < n)
+    gemv_int8_generic(rows, n - i, x, x_scale, m + 2 * i, stride, m_scales + i, y + i);
+}
+
+static void cubic_sse2(unsigned n, float* x) {
+  unsigned i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 v = _mm_loadu_ps(x + i);
+    _mm_storeu_ps(x + i, _mm_mul_ps(_mm_mul_ps(v, v), v));
+  }
+  cubic_generic(n - i, x + i);
+}
+
+static void relu_sse2(unsigned n, float* x) {
+  unsigned i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(x + i, _mm_max_ps(_mm_loadu_ps(x + i), _mm_setzero_ps()));
+  relu_generic(n - i, x + i);
+}
+
+static const vector_kernels kernels_sse2 = {
+  "sse2", add_sse2, gemv_sse2, gemm_sse2, gemv_sparse_sse2, dot_sse2, add_float16_generic, add_bfloat16_sse2,
+  add_int8_sse2, quantize_int8_sse2, gemv_int8_sse2, tanh_generic, cubic_sse2, relu_sse2
+};
+
+// AVX2 implementation
+PARSITO_TARGET_AVX2 static void add_avx2(unsigned n, const float* x, float* y) {
+  unsigned i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_loadu_ps(x + i)));
+  for (; i < n; i++)
+    y[i] += x[i];
+}
+
+PARSITO_TARGET_AVX2 static void gemv_avx2(unsigned rows, unsigned n, const float* x, const float* m, size_t stride, float* y) {
+  unsigned i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256 y0 = _mm256_loadu_ps(y + i), y1 = _mm256_loadu_ps(y + i + 8), y2 = _mm256_loadu_ps(y + i + 16), y3 = _mm256_loadu_ps(y + i + 24);
+    const float* row = m + i;
+    for (unsigned r = 0; r < rows; r++, row += stride) {
+      __m256 xr = _mm256_set1_ps(x[r]);
+      y0 = _mm256_fmadd_ps(xr, _mm256_loadu_ps(row), y0);
+      y1 = _mm256_fmadd_ps(xr, _mm256_loadu_ps(row + 8), y1);
+      y2 = _mm256_fmadd_ps(xr, _mm256_loadu_ps(row + 16), y2);
+      y3 = _mm256_fmadd_ps(xr, _mm256_loadu_ps(row + 24), y3);
+    }
+    _mm256_storeu_ps(y + i, y0); _mm256_storeu_ps(y + i + 8, y1); _mm256_storeu_ps(y + i + 16, y2); _mm256_storeu_ps(y + i + 24, y3);
+  }
+  for (; i + 8 <= n; i += 8) {
+    __m256 y0 = _mm256_loadu_ps(y + i);
+    const float* row = m + i;
+    for (unsigned r = 0; r < rows; r++, row += stride)
+      y0 = _mm256_fmadd_ps(_mm256_set1_ps(x[r]), _mm256_loadu_ps(row), y0);
+    _mm256_storeu_ps(y + i, y0);
+  }
+  if (i < n)
+    gemv_generic(rows, n - i, x, m + i, stride, y + i);
+}
+
+PARSITO_TARGET_AVX2 static void gemm_avx2(unsigned count, unsigned rows, unsigned n, const float* x, size_t x_stride, const float* m, size_t stride, float* y, size_t y_stride) {
+  // Four outputs at a time share the loaded matrix rows
+  unsigned k = 0;
+  for (; k + 4 <= count; k += 4, x += 4 * x_stride, y += 4 * y_stride) {
+    const float *x0 = x, *x1 = x + x_stride, *x2 = x + 2 * x_stride, *x3 = x + 3 * x_stride;
+    float *y0 = y, *y1 = y + y_stride, *y2 = y + 2 * y_stride, *y3 = y + 3 * y_stride;
+    unsigned i = 0;
+    for (; i + 16 <= n; i += 16) {
+      __m256 a0 = _mm256_loadu_ps(y0 + i), b0 = _mm256_loadu_ps(y0 + i + 8), a1 = _mm256_loadu_ps(y1 + i), b1 = _mm256_loadu_ps(y1 + i + 8);
+      __m256 a2 = _mm256_loadu_ps(y2 + i), b2 = _mm256_loadu_ps(y2 + i + 8), a3 = _mm256_loadu_ps(y3 + i), b3 = _mm256_loadu_ps(y3 + i + 8);
+      const float* row = m + i;
+      for (unsigned r = 0; r < rows; r++, row += stride) {
+        __m256 ma = _mm256_loadu_ps(row), mb = _mm256_loadu_ps(row + 8), xr;
+        xr = _mm256_set1_ps(x0[r]); a0 = _mm256_fmadd_ps(xr, ma, a0); b0 = _mm256_fmadd_ps(xr, mb, b0);
+        xr = _mm256_set1_ps(x1[r]); a1 = _mm256_fmadd_ps(xr, ma, a1); b1 = _mm256_fmadd_ps(xr, mb, b1);
+        xr = _mm256_set1_ps(x2[r]); a2 = _mm256_fmadd_ps(xr, ma, a2); b2 = _mm256_fmadd_ps(xr, mb, b2);
+        xr = _mm256_set1_ps(x3[r]); a3 = _mm256_fmadd_ps(xr, ma, a3); b3 = _mm256_fmadd_ps(xr, mb, b3);
+      }
+      _mm256_storeu_ps(y0 + i, a0); _mm256_storeu_ps(y0 + i + 8, b0); _mm256_storeu_ps(y1 + i, a1); _mm256_storeu_ps(y1 + i + 8, b1);
+      _mm256_storeu_ps(y2 + i, a2); _mm256_storeu_ps(y2 + i + 8, b2); _mm256_storeu_ps(y3 + i, a3); _mm256_storeu_ps(y3 + i + 8, b3);
+    }
+    if (i < n)
+      for (unsigned j = 0; j < 4; j++)
+        gemv_avx2(rows, n - i, x + j * x_stride, m + i, stride, y + j * y_stride + i);
+  }
+  for (; k < count; k++, x += x_stride, y += y_stride)
+    gemv_avx2(rows, n, x, m, stride, y);
+}
+
+PARSITO_TARGET_AVX2 static void gemv_sparse_avx2(unsigned rows, unsigned n, const float* x, const float* m, size_t stride, float* y) {
+  unsigned nonzero[SPARSE_CHUNK];
+  for (unsigned start = 0; start < rows; start += SPARSE_CHUNK) {
+    unsigned count = gather_nonzero(start, rows, x, nonzero);
+    unsigned i = 0;
+    for (; i + 32 <= n; i += 32) {
+      __m256 y0 = _mm256_loadu_ps(y + i), y1 = _mm256_loadu_ps(y + i + 8), y2 = _mm256_loadu_ps(y + i + 16), y3 = _mm256_loadu_ps(y + i + 24);
+      for (unsigned k = 0; k < count; k++) {
+        const float* row = m + nonzero[k] * stride + i;
+        __m256 xr = _mm256_set1_ps(x[nonzero[k]]);
+        y0 = _mm256_fmadd_ps(xr, _mm256_loadu_ps(row), y0);
+        y1 = _mm256_fmadd_ps(xr, _mm256_loadu_ps(row + 8), y1);
+        y2 = _mm256_fmadd_ps(xr, _mm256_loadu_ps(row + 16), y2);
+        y3 = _mm256_fmadd_ps(xr, _mm256_loadu_ps(row + 24), y3);
+      }
+      _mm256_storeu_ps(y + i, y0); _mm256_storeu_ps(y + i + 8, y1); _mm256_storeu_ps(y + i + 16, y2); _mm256_storeu_ps(y + i + 24, y3);
+    }
+    for (; i + 8 <= n; i += 8) {
+      __m256 y0 = _mm256_loadu_ps(y + i);
+      for (unsigned k = 0; k < count; k++)
+        y0 = _mm256_fmadd_ps(_mm256_set1_ps(x[nonzero[k]]), _mm256_loadu_ps(m + nonzero[k] * stride + i), y0);
+      _mm256_storeu_ps(y + i, y0);
+    }
+    if (i < n)
+      gemv_rows_generic(count, nonzero, n - i, x, m + i, stride, y + i);
+  }
+}
+
+PARSITO_TARGET_AVX2 static float dot_avx2(unsigned n, const float* x, const float* y) {
+  __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(), s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+  unsigned i = 0;
+  for (; i + 32 <= n; i += 32) {
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), s0);
+    s1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(y + i + 8), s1);
+    s2 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 16), _mm256_loadu_ps(y + i + 16), s2);
+    s3 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 24), _mm256_loadu_ps(y + i + 24), s3);
+  }
+  for (; i + 8 <= n; i += 8)
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), s0);
+  float sums[8];
+  _mm256_storeu_ps(sums, _mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+  return ((sums[0] + sums[1]) + (sums[2] + sums[3])) + ((sums[4] + sums[5]) + (sums[6] + sums[7])) + dot_generic(n - i, x + i, y + i);
+}
+
+PARSITO_TARGET_AVX2 static void add_float16_avx2(unsigned n, const uint16_t* x, float* y) {
+  unsigned i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(x + i)))));
+  add_float16_generic(n - i, x + i, y + i);
+}
+
+PARSITO_TARGET_AVX2 static void add_bfloat16_avx2(unsigned n, const uint16_t* x, float* y) {
+  unsigned i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(x + i))), 16);
+    _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_castsi256_ps(v)));
+  }
+  add_bfloat16_generic(n - i, x + i, y + i);
+}
+
+PARSITO_TARGET_AVX2 static void add_int8_avx2(unsigned n, float scale, const int8_t* x, float* y) {
+  const __m256 s = _mm256_set1_ps(scale);
+  unsigned i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256 v0 = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(x + i))));
+    __m256 v1 = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(x + i + 8))));
+    _mm256_storeu_ps(y + i, _mm256_fmadd_ps(s, v0, _mm256_loadu_ps(y + i)));
+    _mm256_storeu_ps(y + i + 8, _mm256_fmadd_ps(s, v1, _mm256_loadu_ps(y + i + 8)));
+  }
+  add_int8_generic(n - i, scale, x + i, y + i);
+}
+
+PARSITO_TARGET_AVX2 static float quantize_int8_avx2(unsigned n, const float* x, int8_t* q) {
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  __m256 max8 = _mm256_setzero_ps();
+  unsigned i = 0;
+  for (; i + 8 <= n; i += 8)
+    max8 = _mm256_max_ps(max8, _mm256_and_ps(_mm256_loadu_ps(x + i), abs_mask));
+  __m128 max4 = _mm_max_ps(_mm256_castps256_ps128(max8), _mm256_extractf128_ps(max8, 1));
+  max4 = _mm_max_ps(max4, _mm_shuffle_ps(max4, max4, _MM_SHUFFLE(1, 0, 3, 2)));
+  max4 = _mm_max_ps(max4, _mm_shuffle_ps(max4, max4, _MM_SHUFFLE(2, 3, 0, 1)));
+  float max = _mm_cvtss_f32(max4);
+  for (; i < n; i++)
+    if (fabs(x[i]) > max) max = fabs(x[i]);
+
+  float inverse = max ? 127 / max : 0;
+  const __m256 inverse8 = _mm256_set1_ps(inverse);
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(x + i), inverse8));
+    __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    _mm_storel_epi64((__m128i*)(q + i), _mm_packs_epi16(packed, packed));
+  }
+  for (; i < n; i++)
+    q[i] = int8_t(lrint(x[i] * inverse));
+  return max / 127;
+}
+
+PARSITO_TARGET_AVX2 static void gemv_int8_avx2(unsigned rows, unsigned n, const int8_t* x, float x_scale, const int8_t* m, size_t stride, const float* m_scales, float* y) {
+  const __m256 s = _mm256_set1_ps(x_scale);
+  unsigned i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i sum0 = _mm256_setzero_si256(), sum1 = _mm256_setzero_si256();
+    const int8_t* row = m + 2 * i;
+    for (unsigned r = 0; r < rows; r += 2, row += 2 * stride) {
+      __m256i xr = _mm256_set1_epi32(int32_t(uint16_t(int16_t(x[r]))) | (int32_t(x[r + 1]) << 16));
+      sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)row)), xr));
+      sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(row + 16))), xr));
+    }
+    _mm256_storeu_ps(y + i, _mm256_fmadd_ps(_mm256_mul_ps(s, _mm256_loadu_ps(m_scales + i)), _mm256_cvtepi32_ps(sum0), _mm256_loadu_ps(y + i)));
+    _mm256_storeu_ps(y + i + 8, _mm256_fmadd_ps(_mm256_mul_ps(s, _mm256_loadu_ps(m_scales + i + 8)), _mm256_cvtepi32_ps(sum1), _mm256_loadu_ps(y + i + 8)));
+  }
+  if (i < n)
+    gemv_int8_generic(rows, n - i, x, x_scale, m + 2 * i, stride, m_scales + i, y + i);
+}
+
+PARSITO_TARGET_AVX2 static void tanh_avx2(unsigned n, const float* tanh_cache, float* x) {
+  const __m256 low = _mm256_set1_ps(-vector_kernels::TANH_CACHE_RANGE), high = _mm256_set1_ps(vector_kernels::TANH_CACHE_RANGE);
+  const __m256 resolution = _mm256_set1_ps(vector_kernels::TANH_CACHE_RESOLUTION);
+  const __m256 offset = _mm256_set1_ps(vector_kernels::TANH_CACHE_RANGE * vector_kernels::TANH_CACHE_RESOLUTION);
+  const __m256 minus_one = _mm256_set1_ps(-1), one = _mm256_set1_ps(1);
+
+  unsigned i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(x + i);
+    __m256 is_low = _mm256_cmp_ps(v, low, _CMP_LE_OQ), is_high = _mm256_cmp_ps(v, high, _CMP_GE_OQ);
+    __m256 clamped = _mm256_min_ps(_mm256_max_ps(v, low), high);
+    __m256 index = _mm256_add_ps(_mm256_mul_ps(clamped, resolution), offset);
+    __m256 inside = _mm256_andnot_ps(_mm256_or_ps(is_low, is_high), _mm256_castsi256_ps(_mm256_set1_epi32(-1)));
+    __m256 result = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), tanh_cache, _mm256_cvttps_epi32(index), inside, 4);
+    result = _mm256_blendv_ps(result, minus_one, is_low);
+    result = _mm256_blendv_ps(result, one, is_high);
+    _mm256_storeu_ps(x + i, result);
+  }
+  tanh_generic(n - i, tanh_cache, x + i);
+}
+
+PARSITO_TARGET_AVX2 static void cubic_avx2(unsigned n, float* x) {
+  unsigned i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(x + i);
+    _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_mul_ps(v, v), v));
+  }
+  cubic_generic(n - i, x + i);
+}
+
+PARSITO_TARGET_AVX2 static void relu_avx2(unsigned n, float* x) {
+  unsigned i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(x + i, _mm256_max_ps(_mm256_loadu_ps(x + i), _mm256_setzero_ps()));
+  relu_generic(n - i, x + i);
+}
+
+static const vector_kernels kernels_avx2 = {
+  "avx2", add_avx2, gemv_avx2, gemm_avx2, gemv_sparse_avx2, dot_avx2, add_float16_avx2, add_bfloat16_avx2,
+  add_int8_avx2, quantize_int8_avx2, gemv_int8_avx2, tanh_avx2, cubic_avx2, relu_avx2
+};
+
+// AVX-512 implementation
+PARSITO_TARGET_AVX512 static void add_avx512(unsigned n, const float* x, float* y) {
+  unsigned i = 0;
+  for (; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(y + i, _mm512_add_ps(_mm512_loadu_ps(y + i), _mm512_loadu_ps(x + i)));
+  if (i < n) {
+    __mmask16 mask = __mmask16((1U << (n - i)) - 1);
+    _mm512_mask_storeu_ps(y + i, mask, _mm512_add_ps(_mm512_maskz_loadu_ps(mask, y + i), _mm512_maskz_loadu_ps(mask, x + i)));
+  }
+}
+
+PARSITO_TARGET_AVX512 static void gemv_avx512(unsigned rows, unsigned n, const float* x, const float* m, size_t stride, float* y) {
+  unsigned i = 0;
+  for (; i + 64 <= n; i += 64) {
+    __m512 y0 = _mm512_loadu_ps(y + i), y1 = _mm512_loadu_ps(y + i + 16), y2 = _mm512_loadu_ps(y + i + 32), y3 = _mm512_loadu_ps(y + i + 48);
+    const float* row = m + i;
+    for (unsigned r = 0; r < rows; r++, row += stride) {
+      __m512 xr = _mm512_set1_ps(x[r]);
+      y0 = _mm512_fmadd_ps(xr, _mm512_loadu_ps(row), y0);
+      y1 = _mm512_fmadd_ps(xr, _mm512_loadu_ps(row + 16), y1);
+      y2 = _mm512_fmadd_ps(xr, _mm512_loadu_ps(row + 32), y2);
+      y3 = _mm512_fmadd_ps(xr, _mm512_loadu_ps(row + 48), y3);
+    }
+    _mm512_storeu_ps(y + i, y0); _mm512_storeu_ps(y + i + 16, y1); _mm512_storeu_ps(y + i + 32, y2); _mm512_storeu_ps(y + i + 48, y3);
+  }
+  for (; i < n; i += 16) {
+    __mmask16 mask = n - i >= 16 ? __mmask16(0xFFFF) : __mmask16((1U << (n - i)) - 1);
+    __m512 y0 = _mm512_maskz_loadu_ps(mask, y + i);
+    const float* row = m + i;
+    for (unsigned r = 0; r < rows; r++, row += stride)
+      y0 = _mm512_fmadd_ps(_mm512_set1_ps(x[r]), _mm512_maskz_loadu_ps(mask, row), y0);
+    _mm512_mask_storeu_ps(y + i, mask, y0);
+  }
+}
+
+PARSITO_TARGET_AVX512 static void gemm_avx512(unsigned count, unsigned rows, unsigned n, const float* x, size_t x_stride, const float* m, size_t stride, float* y, size_t y_stride) {
+  // Four outputs at a time share the loaded matrix rows
+  unsigned k = 0;
+  for (; k + 4 <= count; k += 4, x += 4 * x_stride, y += 4 * y_stride) {
+    const float *x0 = x, *x1 = x + x_stride, *x2 = x + 2 * x_stride, *x3 = x + 3 * x_stride;
+    float *y0 = y, *y1 = y + y_stride, *y2 = y + 2 * y_stride, *y3 = y + 3 * y_stride;
+    unsigned i = 0;
+    for (; i + 32 <= n; i += 32) {
+      __m512 a0 = _mm512_loadu_ps(y0 + i), b0 = _mm512_loadu_ps(y0 + i + 16), a1 = _mm512_loadu_ps(y1 + i), b1 = _mm512_loadu_ps(y1 + i + 16);
+      __m512 a2 = _mm512_loadu_ps(y2 + i), b2 = _mm512_loadu_ps(y2 + i + 16), a3 = _mm512_loadu_ps(y3 + i), b3 = _mm512_loadu_ps(y3 + i + 16);
+      const float* row = m + i;
+      for (unsigned r = 0; r < rows; r++, row += stride) {
+        __m512 ma = _mm512_loadu_ps(row), mb = _mm512_loadu_ps(row + 16), xr;
+        xr = _mm512_set1_ps(x0[r]); a0 = _mm512_fmadd_ps(xr, ma, a0); b0 = _mm512_fmadd_ps(xr, mb, b0);
+        xr = _mm512_set1_ps(x1[r]); a1 = _mm512_fmadd_ps(xr, ma, a1); b1 = _mm512_fmadd_ps(xr, mb, b1);
+        xr = _mm512_set1_ps(x2[r]); a2 = _mm512_fmadd_ps(xr, ma, a2); b2 = _mm512_fmadd_ps(xr, mb, b2);
+        xr = _mm512_set1_ps(x3[r]); a3 = _mm512_fmadd_ps(xr, ma, a3); b3 = _mm512_fmadd_ps(xr, mb, b3);
+      }
+      _mm512_storeu_ps(y0 + i, a0); _mm512_storeu_ps(y0 + i + 16, b0); _mm512_storeu_ps(y1 + i, a1); _mm512_storeu_ps(y1 + i + 16, b1);
+      _mm512_storeu_ps(y2 + i, a2); _mm512_storeu_ps(y2 + i + 16, b2); _mm512_storeu_ps(y3 + i, a3); _mm512_storeu_ps(y3 + i + 16, b3);
+    }
+    if (i < n)
+      for (unsigned j = 0; j < 4; j++)
+        gemv_avx512(rows, n - i, x + j * x_stride, m + i, stride, y + j * y_stride + i);
+  }
+  for (; k < count; k++, x += x_stride, y += y_stride)
+    gemv_avx512(rows, n, x, m, stride, y);
+}
+
+PARSITO_TARGET_AVX512 static void gemv_sparse_avx512(unsigned rows, unsigned n, const float* x, const float* m, size_t stride, float* y) {
+  unsigned nonzero[SPARSE_CHUNK];
+  for (unsigned start = 0; start < rows; start += SPARSE_CHUNK) {
+    unsigned count = gather_nonzero(start, rows, x, nonzero);
+    unsigned i = 0;
+    for (; i + 64 <= n; i += 64) {
+      __m512 y0 = _mm512_loadu_ps(y + i), y1 = _mm512_loadu_ps(y + i + 16), y2 = _mm512_loadu_ps(y + i + 32), y3 = _mm512_loadu_ps(y + i + 48);
+      for (unsigned k = 0; k < count; k++) {
+        const float* row = m + nonzero[k] * stride + i;
+        __m512 xr = _mm512_set1_ps(x[nonzero[k]]);
+        y0 = _mm512_fmadd_ps(xr, _mm512_loadu_ps(row), y0);
+        y1 = _mm512_fmadd_ps(xr, _mm512_loadu_ps(row + 16), y1);
+        y2 = _mm512_fmadd_ps(xr, _mm512_loadu_ps(row + 32), y2);
+        y3 = _mm512_fmadd_ps(xr, _mm512_loadu_ps(row + 48), y3);
+      }
+      _mm512_storeu_ps(y + i, y0); _mm512_storeu_ps(y + i + 16, y1); _mm512_storeu_ps(y + i + 32, y2); _mm512_storeu_ps(y + i + 48, y3);
+    }
+    for (; i < n; i += 16) {
+      __mmask16 mask = n - i >= 16 ? __mmask16(0xFFFF) : __mmask16((1U << (n - i)) - 1);
+      __m512 y0 = _mm512_maskz_loadu_ps(mask, y + i);
+      for (unsigned k = 0; k < count; k++)
+        y0 = _mm512_fmadd_ps(_mm512_set1_ps(x[nonzero[k]]), _mm512_maskz_loadu_ps(mask, m + nonzero[k] * stride + i), y0);
+      _mm512_mask_storeu_ps(y + i, mask, y0);
+    }
+  }
+}
+
+PARSITO_TARGET_AVX512 static float dot_avx512(unsigned n, const float* x, const float* y) {
+  __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+  unsigned i = 0;
+  for (; i + 32 <= n; i += 32) {
+    s0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), s0);
+    s1 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i + 16), _mm512_loadu_ps(y + i + 16), s1);
+  }
+  if (i < n) {
+    __mmask16 mask = n - i >= 16 ? 0xFFFF : __mmask16((1U << (n - i)) - 1);
+    s0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, x + i), _mm512_maskz_loadu_ps(mask, y + i), s0);
+    i += 16;
+  }
+  if (i < n) {
+    __mmask16 mask = __mmask16((1U << (n - i)) - 1);
+    s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, x + i), _mm512_maskz_loadu_ps(mask, y + i), s1);
+  }
+  float sums[16];
+  _mm512_storeu_ps(sums, _mm512_add_ps(s0, s1));
+  float sum = 0;
+  for (unsigned j = 0; j < 16; j += 4)
+    sum += (sums[j] + sums[j + 1]) + (sums[j + 2] + sums[j + 3]);
+  return sum;
+}
+
+PARSITO_TARGET_AVX512 static void add_float16_avx512(unsigned n, const uint16_t* x, float* y) {
+  unsigned i = 0;
+  for (; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(y + i, _mm512_add_ps(_mm512_loadu_ps(y + i), _mm512_maskz_cvtph_ps(0xFFFF, _mm256_loadu_si256((const __m256i*)(x + i)))));
+  add_float16_avx2(n - i, x + i, y + i);
+}
+
+PARSITO_TARGET_AVX512 static void add_bfloat16_avx512(unsigned n, const uint16_t* x, float* y) {
+  unsigned i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512i v = _mm512_maskz_slli_epi32(0xFFFF, _mm512_maskz_cvtepu16_epi32(0xFFFF, _mm256_loadu_si256((const __m256i*)(x + i))), 16);
+    _mm512_storeu_ps(y + i, _mm512_add_ps(_mm512_loadu_ps(y + i), _mm512_castsi512_ps(v)));
+  }
+  add_bfloat16_avx2(n - i, x + i, y + i);
+}
+
+PARSITO_TARGET_AVX512 static void add_int8_avx512(unsigned n, float scale, const int8_t* x, float* y) {
+  const __m512 s = _mm512_set1_ps(scale);
+  unsigned i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512 v = _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepi8_epi32(0xFFFF, _mm_loadu_si128((const __m128i*)(x + i))));
+    _mm512_storeu_ps(y + i, _mm512_fmadd_ps(s, v, _mm512_loadu_ps(y + i)));
+  }
+  add_int8_generic(n - i, scale, x + i, y + i);
+}
+
+PARSITO_TARGET_AVX512 static float quantize_int8_avx512(unsigned n, const float* x, int8_t* q) {
+  __m512 max16 = _mm512_setzero_ps();
+  for (unsigned i = 0; i < n; i += 16) {
+    __mmask16 mask = n - i >= 16 ? __mmask16(0xFFFF) : __mmask16((1U << (n - i)) - 1);
+    max16 = _mm512_maskz_max_ps(0xFFFF, max16, _mm512_abs_ps(_mm512_maskz_loadu_ps(mask, x + i)));
+  }
+  float lanes[16], max = 0;
+  _mm512_storeu_ps(lanes, max16);
+  for (unsigned i = 0; i < 16; i++)
+    if (lanes[i] > max) max = lanes[i];
+
+  float inverse = max ? 127 / max : 0;
+  const __m512 inverse16 = _mm512_set1_ps(inverse);
+  for (unsigned i = 0; i < n; i += 16) {
+    __mmask16 mask = n - i >= 16 ? __mmask16(0xFFFF) : __mmask16((1U << (n - i)) - 1);
+    __m512i v = _mm512_maskz_cvtps_epi32(mask, _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, x + i), inverse16));
+    _mm512_mask_cvtsepi32_storeu_epi8(q + i, mask, v);
+  }
+  return max / 127;
+}
+
+PARSITO_TARGET_AVX512 static void gemv_int8_avx512(unsigned rows, unsigned n, const int8_t* x, float x_scale, const int8_t* m, size_t stride, const float* m_scales, float* y) {
+  const __m512 s = _mm512_set1_ps(x_scale);
+  unsigned i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m512i sum0 = _mm512_setzero_si512(), sum1 = _mm512_setzero_si512();
+    const int8_t* row = m + 2 * i;
+    for (unsigned r = 0; r < rows; r += 2, row += 2 * stride) {
+      __m512i xr = _mm512_set1_epi32(int32_t(uint16_t(int16_t(x[r]))) | (int32_t(x[r + 1]) << 16));
+      sum0 = _mm512_add_epi32(sum0, _mm512_madd_epi16(_mm512_maskz_cvtepi8_epi16(0xFFFFFFFF, _mm256_loadu_si256((const __m256i*)row)), xr));
+      sum1 = _mm512_add_epi32(sum1, _mm512_madd_epi16(_mm512_maskz_cvtepi8_epi16(0xFFFFFFFF, _mm256_loadu_si256((const __m256i*)(row + 32))), xr));
+    }
+    _mm512_storeu_ps(y + i, _mm512_fmadd_ps(_mm512_mul_ps(s, _mm512_loadu_ps(m_scales + i)), _mm512_maskz_cvtepi32_ps(0xFFFF, sum0), _mm512_loadu_ps(y + i)));
+    _mm512_storeu_ps(y + i + 16, _mm512_fmadd_ps(_mm512_mul_ps(s, _mm512_loadu_ps(m_scales + i + 16)), _mm512_maskz_cvtepi32_ps(0xFFFF, sum1), _mm512_loadu_ps(y + i + 16)));
+  }
+  if (i < n)
+    gemv_int8_avx2(rows, n - i, x, x_scale, m + 2 * i, stride, m_scales + i, y + i);
+}
+
+PARSITO_TARGET_AVX512 static void tanh_avx512(unsigned n, const float* tanh_cache, float* x) {
+  const __m512 low = _mm512_set1_ps(-vector_kernels::TANH_CACHE_RANGE), high = _mm512_set1_ps(vector_kernels::TANH_CACHE_RANGE);
+  const __m512 resolution = _mm512_set1_ps(vector_kernels::TANH_CACHE_RESOLUTION);
+  const __m512 offset = _mm512_set1_ps(vector_kernels::TANH_CACHE_RANGE * vector_kernels::TANH_CACHE_RESOLUTION);
+  const __m512 minus_one = _mm512_set1_ps(-1), one = _mm512_set1_ps(1);
+
+  for (unsigned i = 0; i < n; i += 16) {
+    __mmask16 mask = n - i >= 16 ? __mmask16(0xFFFF) : __mmask16((1U << (n - i)) - 1);
+    __m512 v = _mm512_maskz_loadu_ps(mask, x + i);
+    __mmask16 is_low = _mm512_cmp_ps_mask(v, low, _CMP_LE_OQ), is_high = _mm512_cmp_ps_mask(v, high, _CMP_GE_OQ);
+    __m512 clamped = _mm512_maskz_min_ps(mask, _mm512_maskz_max_ps(mask, v, low), high);
+    __m512 index = _mm512_add_ps(_mm512_mul_ps(clamped, resolution), offset);
+    __m512 result = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask & ~(is_low | is_high), _mm512_maskz_cvttps_epi32(mask, index), tanh_cache, 4);
+    result = _mm512_mask_mov_ps(result, is_low, minus_one);
+    result = _mm512_mask_mov_ps(result, is_high, one);
+    _mm512_mask_storeu_ps(x + i, mask, result);
+  }
+}
+
+PARSITO_TARGET_AVX512 static void cubic_avx512(unsigned n, float* x) {
+  for (unsigned i = 0; i < n; i += 16) {
+    __mmask16 mask = n - i >= 16 ? __mmask16(0xFFFF) : __mmask16((1U << (n - i)) - 1);
+    __m512 v = _mm512_maskz_loadu_ps(mask, x + i);
+    _mm512_mask_storeu_ps(x + i, mask, _mm512_mul_ps(_mm512_mul_ps(v, v), v));
+  }
+}
+
+PARSITO_TARGET_AVX512 static void relu_avx512(unsigned n, float* x) {
+  for (unsigned i = 0; i < n; i += 16) {
+    __mmask16 mask = n - i >= 16 ? __mmask16(0xFFFF) : __mmask16((1U << (n - i)) - 1);
+    _mm512_mask_storeu_ps(x + i, mask, _mm512_maskz_max_ps(mask, _mm512_maskz_loadu_ps(mask, x + i), _mm512_setzero_ps()));
+  }
+}
+
+static const vector_kernels kernels_avx512 = {
+  "avx512", add_avx512, gemv_avx512, gemm_avx512, gemv_sparse_avx512, dot_avx512, add_float16_avx512, add_bfloat16_avx512,
+  add_int8_avx512, quantize_int8_avx512, gemv_int8_avx512, tanh_avx512, cubic_avx512, relu_avx512
+};
+
+// CPU detection
+static void cpuid(unsigned leaf, unsigned subleaf, unsigned registers[4]) {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuidex(info, int(leaf), int(subleaf));
+  for (int i = 0; i < 4; i++) registers[i] = unsigned(info[i]);
+#else
+  __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+static uint64_t xgetbv0() {
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  uint32_t eax, edx;
+  __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (uint64_t(edx) << 32) | eax;
+#endif
+}
+
+static const vector_kernels& detect_kernels() {
+  unsigned registers[4];
+  cpuid(0, 0, registers);
+  unsigned max_leaf = registers[0];
+
+  cpuid(1, 0, registers);
+  bool sse2 = registers[3] & (1U << 26);
+  bool fma = registers[2] & (1U << 12), osxsave = registers[2] & (1U << 27), avx = registers[2] & (1U << 28);
+  bool f16c = registers[2] & (1U << 29);
+
+  bool avx2 = false, avx512 = false;
+  if (osxsave && avx && max_leaf >= 7) {
+    uint64_t xcr0 = xgetbv0();
+    cpuid(7, 0, registers);
+    avx2 = (xcr0 & 0x06) == 0x06 && fma && f16c && (registers[1] & (1U << 5));
+    avx512 = (xcr0 & 0xE6) == 0xE6 && avx2 && (registers[1] & (1U << 16)) && (registers[1] & (1U << 30));
+  }
+
+  return avx512 ? kernels_avx512 : avx2 ? kernels_avx2 : sse2 ? kernels_sse2 : kernels_generic;
+}
+#else
+static const vector_kernels& detect_kernels() {
+  return kernels_generic;
+}
+#endif
+
+const vector_kernels& vector_kernels::best() {
+  static const vector_kernels& kernels = detect_kernels();
+  return kernels;
+}
+
+} // namespace parsito
+} // namespace ufal
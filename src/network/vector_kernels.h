@@ -0,0 +1,66 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include "common.h"
+
+namespace ufal {
+namespace parsito {
+
+// Vectorized kernels used by neural_network::propagate. The implementation
+// for the best instruction set supported by the CPU is chosen on first use.
+struct vector_kernels {
+  const char* name;
+
+  // y[0..n) += x[0..n)
+  void (*add)(unsigned n, const float* x, float* y);
+
+  // y[0..n) += sum_{r < rows} x[r] * m[r * stride + 0..n)
+  void (*gemv)(unsigned rows, unsigned n, const float* x, const float* m, size_t stride, float* y);
+
+  // y_k[0..n) += sum_{r < rows} x_k[r] * m[r * stride + 0..n) for k < count,
+  // where x_k = x + k * x_stride and y_k = y + k * y_stride; every y_k is
+  // computed exactly as gemv would compute it
+  void (*gemm)(unsigned count, unsigned rows, unsigned n, const float* x, size_t x_stride, const float* m, size_t stride, float* y, size_t y_stride);
+
+  // Same as gemv, but skipping the rows with zero x[r], which is faster when
+  // most x[r] are zero
+  void (*gemv_sparse)(unsigned rows, unsigned n, const float* x, const float* m, size_t stride, float* y);
+
+  // sum_{i < n} x[i] * y[i]
+  float (*dot)(unsigned n, const float* x, const float* y);
+
+  // y[0..n) += x[0..n), where x is stored in float16 or bfloat16 format
+  void (*add_float16)(unsigned n, const uint16_t* x, float* y);
+  void (*add_bfloat16)(unsigned n, const uint16_t* x, float* y);
+
+  // Kernels of the quantized network evaluation:
+  // y[0..n) += scale * x[0..n)
+  void (*add_int8)(unsigned n, float scale, const int8_t* x, float* y);
+  // q[0..n) = round(x[0..n) / scale), where the returned scale is max |x| / 127
+  float (*quantize_int8)(unsigned n, const float* x, int8_t* q);
+  // y[0..n) += x_scale * m_scales[0..n) * sum_{r < rows} x[r] * m[r][0..n),
+  // with the sum computed exactly using int32 accumulators. The number of rows
+  // must be even and the rows are stored interleaved in pairs, i.e., m[r][i] is
+  // stored at m[r / 2 * 2 * stride + 2 * i + r % 2].
+  void (*gemv_int8)(unsigned rows, unsigned n, const int8_t* x, float x_scale, const int8_t* m, size_t stride, const float* m_scales, float* y);
+
+  // Activation functions applied in place. The tanh uses a precomputed table
+  // of tanh(i / TANH_CACHE_RESOLUTION - TANH_CACHE_RANGE) values.
+  enum { TANH_CACHE_RANGE = 10, TANH_CACHE_RESOLUTION = 32768 };
+  void (*tanh)(unsigned n, const float* tanh_cache, float* x);
+  void (*cubic)(unsigned n, float* x);
+  void (*relu)(unsigned n, float* x);
+
+  static const vector_kernels& best();
+};
+
+} // namespace parsito
+} // namespace ufal
@@ -17,13 +17,33 @@
 namespace ufal {
 namespace parsito {
 
+void parser::parse_batch(vector<tree>& trees, unsigned beam_size) const {
+  for (auto&& t : trees)
+    parse(t, beam_size);
+}
+
+parser::degradation_t parser::parse(tree& t, unsigned beam_size, const parse_budget& /*budget*/) const {
+  parse(t, beam_size);
+  return NOT_DEGRADED;
+}
+
+void parser::trim_memory() const {}
+
 parser* parser::load(const char* file, unsigned cache) {
+  return load(file, load_options(cache));
+}
+
+parser* parser::load(istream& in, unsigned cache) {
+  return load(in, load_options(cache));
+}
+
+parser* parser::load(const char* file, const load_options& options) {
   ifstream in(path_from_utf8(file).c_str(), ifstream::in | ifstream::binary);
   if (!in.is_open()) return nullptr;
-  return load(in, cache);
+  return load(in, options);
 }
 
-parser* parser::load(istream& in, unsigned cache) {
+parser* parser::load(istream& in, const load_options& options) {
   unique_ptr<parser> result;
 
   binary_decoder data;
@@ -36,7 +56,7 @@ parser* parser::load(istream& in, unsigned cache) {
     result.reset(create(name));
     if (!result) return nullptr;
 
-    result->load(data, cache);
+    result->load(data, options);
   } catch (binary_decoder_error&) {
     return nullptr;
   }
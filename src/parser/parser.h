@@ -23,13 +23,51 @@ class parser {
   virtual ~parser() {};
 
   virtual void parse(tree& t, unsigned beam_size = 0) const = 0;
+  virtual void parse_batch(vector<tree>& trees, unsigned beam_size = 0) const;
+
+  // Parse a tree within the given budget, degrading the parse when it cannot be
+  // afforded, and return whether and how the parse was degraded.
+  struct parse_budget {
+    explicit parse_budget(unsigned steps = 0, double seconds = 0) : steps(steps), seconds(seconds) {}
+
+    unsigned steps;
+    double seconds;
+  };
+  enum degradation_t { NOT_DEGRADED, DEGRADED_TO_GREEDY, DEGRADED_TO_FALLBACK };
+  virtual degradation_t parse(tree& t, unsigned beam_size, const parse_budget& budget) const;
+
+  // Deallocate the cached workspaces, which are recreated on demand.
+  virtual void trim_memory() const;
 
   enum { NO_CACHE = 0, FULL_CACHE = 2147483647};
+  struct load_options {
+    enum precision_t { DEFAULT_PRECISION, FLOAT32, FLOAT16, BFLOAT16, INT8 };
+
+    explicit load_options(unsigned cache = 1000) : cache(cache), cache_precision(DEFAULT_PRECISION), cache_threads(1), cache_lazy(false), cache_memory(0), quantized(false), beam_threads(1), beam_recombination(false), beam_min_length(0), beam_max_length(0), beam_margin(0), workspaces(0), workspace_memory(0) {}
+
+    unsigned cache;
+    precision_t cache_precision;
+    unsigned cache_threads;
+    bool cache_lazy;
+    unsigned cache_memory;
+    string cache_file;
+    string cache_profile;
+    bool quantized;
+    unsigned beam_threads;
+    bool beam_recombination;
+    unsigned beam_min_length;
+    unsigned beam_max_length;
+    float beam_margin;
+    unsigned workspaces;
+    unsigned workspace_memory;
+  };
   static parser* load(const char* file, unsigned cache = 1000);
   static parser* load(istream& in, unsigned cache = 1000);
+  static parser* load(const char* file, const load_options& options);
+  static parser* load(istream& in, const load_options& options);
 
  protected:
-  virtual void load(binary_decoder& data, unsigned cache) = 0;
+  virtual void load(binary_decoder& data, const load_options& options) = 0;
   static parser* create(const string& name);
 };
 
@@ -0,0 +1,80 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "parser_cascade.h"
+
+namespace ufal {
+namespace parsito {
+
+parser_cascade::parser_cascade(parser_nn* small, parser* large, float margin) : small(small), large(large), margin(margin) {}
+
+void parser_cascade::parse(tree& t, unsigned beam_size) const {
+  if (small->parse_margin(t) < margin)
+    large->parse(t, beam_size);
+}
+
+void parser_cascade::parse_batch(vector<tree>& trees, unsigned beam_size) const {
+  vector<float> margins;
+  small->parse_batch_margins(trees, margins);
+
+  // Parse the trees with an ambiguous decision using the large parser
+  vector<tree> ambiguous;
+  for (size_t i = 0; i < trees.size(); i++)
+    if (margins[i] < margin) {
+      ambiguous.emplace_back();
+      swap(ambiguous.back(), trees[i]);
+    }
+  if (ambiguous.empty()) return;
+
+  large->parse_batch(ambiguous, beam_size);
+
+  for (size_t i = 0, j = 0; i < trees.size(); i++)
+    if (margins[i] < margin)
+      swap(trees[i], ambiguous[j++]);
+}
+
+parser::degradation_t parser_cascade::parse(tree& t, unsigned beam_size, const parse_budget& budget) const {
+  // The budget applies to the large parser only
+  return small->parse_margin(t) < margin ? large->parse(t, beam_size, budget) : NOT_DEGRADED;
+}
+
+void parser_cascade::trim_memory() const {
+  small->trim_memory();
+  large->trim_memory();
+}
+
+parser* parser_cascade::load(const char* small_file, const char* large_file, float margin,
+                             const load_options& small_options, const load_options& large_options) {
+  unique_ptr<parser> small(parser::load(small_file, small_options));
+  if (!small || !dynamic_cast<parser_nn*>(small.get())) return nullptr;
+
+  unique_ptr<parser> large(parser::load(large_file, large_options));
+  if (!large) return nullptr;
+
+  return new parser_cascade(static_cast<parser_nn*>(small.release()), large.release(), margin);
+}
+
+parser::load_options parser_cascade::small_load_options(const load_options& large_options) {
+  load_options options = large_options;
+  options.cache_file.clear();
+  options.cache_profile.clear();
+  options.beam_threads = 1;
+  options.beam_recombination = false;
+  options.beam_min_length = 0;
+  options.beam_max_length = 0;
+  options.beam_margin = 0;
+  return options;
+}
+
+void parser_cascade::load(binary_decoder& /*data*/, const load_options& /*options*/) {
+  throw binary_decoder_error("The parser cascade cannot be loaded from a single model");
+}
+
+} // namespace parsito
+} // namespace ufal
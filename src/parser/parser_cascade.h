@@ -0,0 +1,52 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include "common.h"
+#include "parser.h"
+#include "parser_nn.h"
+
+namespace ufal {
+namespace parsito {
+
+// Cascade of a small and a large parser. Every tree is parsed greedily by the
+// small parser, and parsed again by the large one only if the difference between
+// the probabilities of the two best transitions of some decision of the small
+// parser is smaller than the given margin. The cascade owns both parsers.
+class parser_cascade : public parser {
+ public:
+  parser_cascade(parser_nn* small, parser* large, float margin);
+
+  virtual void parse(tree& t, unsigned beam_size = 0) const override;
+  virtual void parse_batch(vector<tree>& trees, unsigned beam_size = 0) const override;
+  virtual degradation_t parse(tree& t, unsigned beam_size, const parse_budget& budget) const override;
+  virtual void trim_memory() const override;
+
+  // Load the small nn parser and the large parser, each using its own options,
+  // returning nullptr if any of them cannot be loaded.
+  static parser* load(const char* small_file, const char* large_file, float margin,
+                      const load_options& small_options, const load_options& large_options);
+
+  // Options of the small parser derived from the options of the large one. The
+  // cache file and cache profile are specific to the large model and the small
+  // parser parses greedily, so these and the beam search options are reset.
+  static load_options small_load_options(const load_options& large_options);
+
+ protected:
+  virtual void load(binary_decoder& data, const load_options& options) override;
+
+ private:
+  unique_ptr<parser_nn> small;
+  unique_ptr<parser> large;
+  float margin;
+};
+
+} // namespace parsito
+} // namespace ufal
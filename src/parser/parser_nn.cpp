@@ -8,9 +8,13 @@
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <fstream>
+#include <limits>
 
 #include "parser_nn.h"
+#include "utils/path_from_utf8.h"
 
 namespace ufal {
 namespace parsito {
@@ -19,73 +23,221 @@ namespace parsito {
 // 1: initial version
 // 2: add ReLU activation function
 
-parser_nn::parser_nn(bool versioned) : versioned(versioned) {}
+parser_nn::parser_nn(bool versioned)
+    : versioned(versioned), beam_recombination(false), beam_min_length(0), beam_max_length(0), beam_margin(0), workspace_memory(0) {}
+
+// Tracks the network evaluations and the time used by a parse with a budget
+class parser_nn::budget_tracker {
+ public:
+  budget_tracker(const parse_budget& budget) : budget(budget), used(0) {
+    if (budget.seconds > 0) start = chrono::steady_clock::now();
+  }
+
+  // Whether the given number of network evaluations can be afforded, estimating
+  // their duration using the evaluations performed so far
+  bool affords(size_t evaluations) const {
+    if (budget.steps && used + evaluations > budget.steps) return false;
+    if (budget.seconds > 0) {
+      double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      if (elapsed >= budget.seconds || (used && elapsed + elapsed / used * evaluations > budget.seconds)) return false;
+    }
+    return true;
+  }
+
+  void use(size_t evaluations) { used += evaluations; }
+
+ private:
+  const parse_budget& budget;
+  size_t used;
+  chrono::steady_clock::time_point start;
+};
 
 void parser_nn::parse(tree& t, unsigned beam_size) const {
-  if (beam_size > 1)
+  if (beam_size > 1 && beam_search_length(t)) {
+    // With beam_margin, use beam search only if a greedy decision was ambiguous
+    if (beam_margin > 0) {
+      float margin;
+      parse_greedy(&t, 1, nullptr, &margin);
+      if (margin >= beam_margin) return;
+    }
     parse_beam_search(t, beam_size);
-  else
-    parse_greedy(t);
+  } else {
+    parse_greedy(&t, 1);
+  }
+}
+
+parser::degradation_t parser_nn::parse(tree& t, unsigned beam_size, const parse_budget& budget) const {
+  budget_tracker tracker(budget);
+
+  if (beam_size > 1 && beam_search_length(t)) {
+    // With beam_margin, use beam search only if a greedy decision was ambiguous,
+    // the greedy parse counting towards the budget
+    float margin;
+    if (beam_margin > 0) {
+      degradation_t degradation = parse_greedy(&t, 1, &tracker, &margin);
+      if (degradation != NOT_DEGRADED || margin >= beam_margin) return degradation;
+    }
+    return parse_beam_search(t, beam_size, &tracker);
+  } else {
+    return parse_greedy(&t, 1, &tracker);
+  }
 }
 
-void parser_nn::parse_greedy(tree& t) const {
+void parser_nn::parse_batch(vector<tree>& trees, unsigned beam_size) const {
+  if (beam_size > 1 && beam_margin > 0) {
+    // Parse all the trees greedily together, and then use beam search for the
+    // trees of suitable length with an ambiguous greedy decision
+    vector<float> margins(trees.size());
+    parse_greedy(trees.data(), trees.size(), nullptr, margins.data());
+    for (size_t i = 0; i < trees.size(); i++)
+      if (margins[i] < beam_margin && beam_search_length(trees[i]))
+        parse_beam_search(trees[i], beam_size);
+  } else if (beam_size > 1) {
+    for (auto&& t : trees)
+      if (beam_search_length(t))
+        parse_beam_search(t, beam_size);
+      else
+        parse_greedy(&t, 1);
+  } else {
+    parse_greedy(trees.data(), trees.size());
+  }
+}
+
+float parser_nn::parse_margin(tree& t) const {
+  float margin;
+  parse_greedy(&t, 1, nullptr, &margin);
+  return margin;
+}
+
+void parser_nn::parse_batch_margins(vector<tree>& trees, vector<float>& margins) const {
+  margins.resize(trees.size());
+  parse_greedy(trees.data(), trees.size(), nullptr, margins.data());
+}
+
+bool parser_nn::beam_search_length(const tree& t) const {
+  size_t words = t.nodes.size() - 1;
+  return words >= beam_min_length && (!beam_max_length || words <= beam_max_length);
+}
+
+void parser_nn::trim_memory() const {
+  workspaces.clear();
+}
+
+parser::degradation_t parser_nn::parse_greedy(tree* trees, unsigned count, budget_tracker* budget, float* margins) const {
   assert(system);
 
+  degradation_t degradation = NOT_DEGRADED;
+
   // Retrieve or create workspace
   workspace* w = workspaces.pop();
-  if (!w) w = new workspace(single_root);
+  if (!w) w = new workspace();
 
-  // Create configuration
-  w->conf.init(&t);
+  // Create configurations and compute embeddings of all nodes
+  while (w->greedy_states.size() < count) w->greedy_states.emplace_back(single_root);
+  w->greedy_active.clear();
+  for (unsigned b = 0; b < count; b++) {
+    tree& t = trees[b];
+    auto& state = w->greedy_states[b];
 
-  // Compute embeddings of all nodes
-  if (w->embeddings.size() < t.nodes.size()) w->embeddings.resize(t.nodes.size());
-  for (size_t i = 0; i < t.nodes.size(); i++) {
-    if (w->embeddings[i].size() < embeddings.size()) w->embeddings[i].resize(embeddings.size());
-    for (size_t j = 0; j < embeddings.size(); j++) {
-      values[j].extract(t.nodes[i], w->word);
-      w->embeddings[i][j] = embeddings[j].lookup_word(w->word, w->word_buffer);
-    }
+    state.conf.init(&t);
+
+    if (state.embeddings.size() < t.nodes.size()) state.embeddings.resize(t.nodes.size());
+    for (size_t i = 0; i < t.nodes.size(); i++)
+      embed_node(t.nodes[i], state.embeddings[i], w->word, w->word_buffer);
+
+    if (!state.conf.final()) w->greedy_active.push_back(b);
+    if (margins) margins[b] = 1;
   }
 
-  // Compute which transitions to perform and perform them
-  while (!w->conf.final()) {
-    // Extract nodes from the configuration
-    nodes.extract(w->conf, w->extracted_nodes);
-    w->extracted_embeddings.resize(w->extracted_nodes.size());
-    for (size_t i = 0; i < w->extracted_nodes.size(); i++)
-      w->extracted_embeddings[i] = w->extracted_nodes[i] >= 0 ? &w->embeddings[w->extracted_nodes[i]] : nullptr;
-
-    // Classify using neural network
-    network.propagate(embeddings, w->extracted_embeddings, w->network_buffer, w->outcomes, &embeddings_cache, false);
-
-    // Find most probable applicable transition
-    int best = -1;
-    for (unsigned i = 0; i < w->outcomes.size(); i++)
-      if (system->applicable(w->conf, i) && (best < 0 || w->outcomes[i] > w->outcomes[best]))
-        best = i;
-
-    // Perform the best transition
-    int child = system->perform(w->conf, best);
-
-    // If a node was linked, recompute its embeddings as deprel has changed
-    if (child >= 0)
-      for (size_t i = 0; i < embeddings.size(); i++) {
-        values[i].extract(t.nodes[child], w->word);
-        w->embeddings[child][i] = embeddings[i].lookup_word(w->word, w->word_buffer);
+  // Compute which transitions to perform and perform them, for all
+  // unfinished trees in lockstep
+  unsigned transitions = system->transition_count();
+  while (!w->greedy_active.empty()) {
+    // If the budget cannot afford another step, finish the trees without the network
+    if (budget && !budget->affords(w->greedy_active.size())) {
+      for (auto&& b : w->greedy_active) {
+        auto& conf = w->greedy_states[b].conf;
+        while (!conf.final())
+          system->perform(conf, first_applicable(conf));
+      }
+      degradation = DEGRADED_TO_FALLBACK;
+      break;
+    }
+    if (budget) budget->use(w->greedy_active.size());
+
+    // Extract nodes from the configurations and find applicable transitions
+    w->greedy_batch.clear();
+    w->greedy_masks.clear();
+    for (auto&& b : w->greedy_active) {
+      auto& state = w->greedy_states[b];
+      nodes.extract(state.conf, state.extracted_nodes);
+      state.extracted_embeddings.resize(state.extracted_nodes.size());
+      for (size_t i = 0; i < state.extracted_nodes.size(); i++)
+        state.extracted_embeddings[i] = state.extracted_nodes[i] >= 0 ? &state.embeddings[state.extracted_nodes[i]] : nullptr;
+      if (!embeddings_profile.empty()) embeddings_profile.add(state.extracted_embeddings);
+      w->greedy_batch.push_back(&state.extracted_embeddings);
+
+      state.applicable.resize(transitions);
+      for (unsigned i = 0; i < transitions; i++)
+        state.applicable[i] = system->applicable(state.conf, i);
+      w->greedy_masks.push_back(&state.applicable);
+    }
+
+    // Classify using neural network, computing only the applicable transitions
+    network.propagate_batch_masked(embeddings, w->greedy_batch, w->greedy_masks, w->network_buffer, w->quantized_buffer, w->outcomes, &embeddings_cache);
+
+    unsigned active = 0;
+    for (unsigned a = 0; a < w->greedy_active.size(); a++) {
+      auto& state = w->greedy_states[w->greedy_active[a]];
+      const float* outcomes = w->outcomes.data() + a * transitions;
+
+      // Find most probable applicable transition
+      int best = -1;
+      for (unsigned i = 0; i < transitions; i++)
+        if (state.applicable[i] && (best < 0 || outcomes[i] > outcomes[best]))
+          best = i;
+
+      // Track the smallest margin between the probabilities of the two best
+      // applicable transitions, computed using softmax of the applicable ones
+      if (margins) {
+        int second = -1;
+        float sum = 0;
+        for (unsigned i = 0; i < transitions; i++)
+          if (state.applicable[i]) {
+            sum += exp(outcomes[i] - outcomes[best]);
+            if (int(i) != best && (second < 0 || outcomes[i] > outcomes[second])) second = i;
+          }
+        if (second >= 0)
+          margins[w->greedy_active[a]] = min(margins[w->greedy_active[a]], (1 - exp(outcomes[second] - outcomes[best])) / sum);
       }
+
+      // Perform the best transition
+      int child = system->perform(state.conf, best);
+
+      // If a node was linked, update its embeddings as deprel has changed
+      if (child >= 0)
+        embed_node_label(system->label(best), state.embeddings[child]);
+
+      if (!state.conf.final()) w->greedy_active[active++] = w->greedy_active[a];
+    }
+    w->greedy_active.resize(active);
   }
 
-  // Store workspace
-  workspaces.push(w);
+  // Store workspace, unless it retains more memory than allowed
+  if (workspace_memory && w->memory() > workspace_memory) delete w; else workspaces.push(w);
+
+  return degradation;
 }
 
-void parser_nn::parse_beam_search(tree& t, unsigned beam_size) const {
+parser::degradation_t parser_nn::parse_beam_search(tree& t, unsigned beam_size, budget_tracker* budget) const {
   assert(system);
 
+  degradation_t degradation = NOT_DEGRADED;
+  unsigned search_beam_size = beam_size;
+
   // Retrieve or create workspace
   workspace* w = workspaces.pop();
-  if (!w) w = new workspace(single_root);
+  if (!w) w = new workspace();
 
   // Allocate and initialize configuration
   for (int i = 0; i < 2; i++) {
@@ -93,87 +245,231 @@ void parser_nn::parse_beam_search(tree& t, unsigned beam_size) const {
     while (w->bs_confs[i].size() > beam_size) w->bs_confs[i].pop_back();
     w->bs_confs_size[i] = 0;
   }
-  w->bs_confs[0][0].cost = 0;
-  w->bs_confs[0][0].conf.init(&t);
-  w->bs_confs[0][0].save_tree();
+  auto& bs_conf_initial = w->bs_confs[0][0];
+  bs_conf_initial.cost = 0;
+  bs_conf_initial.conf.init(&t);
+  bs_conf_initial.heads.assign(t.nodes.size(), -1);
+  bs_conf_initial.labels.assign(t.nodes.size(), -1);
+  bs_conf_initial.embeddings.resize(t.nodes.size());
   w->bs_confs_size[0] = 1;
 
-  // Compute embeddings of all nodes
-  if (w->embeddings.size() < t.nodes.size()) w->embeddings.resize(t.nodes.size());
-  if (w->embeddings_values.size() < t.nodes.size()) w->embeddings_values.resize(t.nodes.size());
+  // Compute embeddings of all nodes; the embeddings of a node with a given
+  // label are computed when first needed and then shared by all configurations
+  if (w->bs_embeddings.size() < t.nodes.size()) w->bs_embeddings.resize(t.nodes.size());
   for (size_t i = 0; i < t.nodes.size(); i++) {
-    if (w->embeddings[i].size() < embeddings.size()) w->embeddings[i].resize(embeddings.size());
-    if (w->embeddings_values[i].size() < embeddings.size()) w->embeddings_values[i].resize(embeddings.size());
-    for (size_t j = 0; j < embeddings.size(); j++) {
-      values[j].extract(t.nodes[i], w->embeddings_values[i][j]);
-      w->embeddings[i][j] = embeddings[j].lookup_word(w->embeddings_values[i][j], w->word_buffer);
-    }
+    embed_node(t.nodes[i], w->bs_embeddings[i], w->word, w->word_buffer);
+    bs_conf_initial.embeddings[i] = i;
   }
+  w->bs_embeddings_size = t.nodes.size();
+  w->bs_embeddings_labeled.assign(t.nodes.size() * labels.size(), -1);
+
+  // The configurations of every step are expanded in chunks, in parallel if
+  // beam_workers are available; every chunk uses its own copy of the tree
+  unsigned chunks = beam_workers ? min(beam_workers->threads(), beam_size) : 1;
+  if (w->bs_chunks.size() < chunks) w->bs_chunks.resize(chunks);
+  for (unsigned i = 1; i < chunks; i++)
+    w->bs_chunks[i].t = t;
+
+  auto extract = [&](workspace::beam_size_configuration& bs_conf, tree* conf_tree, vector<int>& extracted_nodes) {
+    bs_conf.conf.t = conf_tree;
+    bs_conf.refresh_tree();
+    nodes.extract(bs_conf.conf, extracted_nodes);
+    bs_conf.conf.t = &t;
+    bs_conf.extracted_embeddings.resize(extracted_nodes.size());
+    for (size_t i = 0; i < extracted_nodes.size(); i++)
+      bs_conf.extracted_embeddings[i] = extracted_nodes[i] >= 0 ? &w->bs_embeddings[bs_conf.embeddings[extracted_nodes[i]]] : nullptr;
+  };
+
+  auto expand = [&](unsigned chunk_index, size_t iteration, unsigned chunks) {
+    auto& chunk = w->bs_chunks[chunk_index];
+    tree* chunk_tree = chunk_index ? &chunk.t : &t;
+    size_t first = w->bs_confs_size[iteration & 1] * chunk_index / chunks;
+    size_t last = w->bs_confs_size[iteration & 1] * (chunk_index + 1) / chunks;
+
+    // Extract nodes from all unfinished configurations
+    chunk.batch.clear();
+    for (size_t c = first; c < last; c++) {
+      auto& bs_conf = w->bs_confs[iteration & 1][c];
+      if (bs_conf.conf.final() || bs_conf.merged) continue;
 
-  // Compute which transitions to perform and perform them
-  size_t iteration = 0;
-  for (bool all_final = false; !all_final; iteration++) {
-    all_final = true;
-    w->bs_alternatives.clear();
+      // With recombination, the nodes have already been extracted
+      if (!beam_recombination) extract(bs_conf, chunk_tree, chunk.extracted_nodes);
+      if (!embeddings_profile.empty()) embeddings_profile.add(bs_conf.extracted_embeddings);
+      chunk.batch.push_back(&bs_conf.extracted_embeddings);
+    }
 
-    for (size_t c = 0; c < w->bs_confs_size[iteration & 1]; c++) {
+    // Classify all of them together using neural network, without softmax
+    if (!chunk.batch.empty())
+      network.propagate_batch(embeddings, chunk.batch, chunk.network_buffer, chunk.quantized_buffer, chunk.outcomes, &embeddings_cache, false);
+
+    // Keep the beam_size best alternatives
+    chunk.best.clear(search_beam_size);
+    unsigned transitions = system->transition_count(), batch_index = 0;
+    if (chunk.candidates.size() < transitions) chunk.candidates.resize(transitions);
+    for (size_t c = first; c < last; c++) {
       auto& bs_conf = w->bs_confs[iteration & 1][c];
+      if (bs_conf.merged) continue;
 
       if (bs_conf.conf.final()) {
-        if (w->bs_alternatives.size() == beam_size) {
-          if (bs_conf.cost <= w->bs_alternatives[0].cost) continue;
-          pop_heap(w->bs_alternatives.begin(), w->bs_alternatives.end());
-          w->bs_alternatives.pop_back();
-        }
-        w->bs_alternatives.emplace_back(&bs_conf, -1, bs_conf.cost);
-        push_heap(w->bs_alternatives.begin(), w->bs_alternatives.end());
+        if (bs_conf.cost > chunk.best.threshold())
+          chunk.best.add(&bs_conf, -1, bs_conf.cost);
         continue;
       }
-      all_final = false;
-
-      bs_conf.refresh_tree();
-      // Update embeddings for all nodes
-      for (size_t i = 0; i < t.nodes.size(); i++)
-        for (size_t j = 0; j < embeddings.size(); j++) {
-          values[j].extract(t.nodes[i], w->word);
-          if (w->word != w->embeddings_values[i][j]) {
-            w->embeddings[i][j] = embeddings[j].lookup_word(w->word, w->word_buffer);
-            w->embeddings_values[i][j].assign(w->word);
-          }
+
+      // Compute the log-softmax normalization of the outcomes
+      const float* outcomes = chunk.outcomes.data() + batch_index++ * transitions;
+      float max = outcomes[0];
+      for (unsigned i = 1; i < transitions; i++) if (outcomes[i] > max) max = outcomes[i];
+      float sum = 0;
+      for (unsigned i = 0; i < transitions; i++) sum += exp(outcomes[i] - max);
+      double log_normalization = max + log(sum);
+
+      // Only outcomes above the current threshold can be among the best alternatives;
+      // the threshold is slightly lowered, so that rounding cannot exclude any of them.
+      double threshold = chunk.best.threshold() * (iteration + 1) - bs_conf.cost * iteration + log_normalization;
+      float outcome_threshold = threshold - 1e-4 * (1 + fabs(threshold));
+      unsigned candidates = 0;
+      for (unsigned i = 0; i < transitions; i++)
+        chunk.candidates[candidates] = i, candidates += outcomes[i] > outcome_threshold;
+
+      for (unsigned j = 0; j < candidates; j++) {
+        unsigned i = chunk.candidates[j];
+        if (system->applicable(bs_conf.conf, i)) {
+          double cost = (bs_conf.cost * iteration + (outcomes[i] - log_normalization)) / (iteration + 1);
+          if (cost > chunk.best.threshold())
+            chunk.best.add(&bs_conf, i, cost);
         }
+      }
+    }
+  };
+
+  // Compute which transitions to perform and perform them
+  size_t iteration = 0;
+  for (bool all_final = false; !all_final; iteration++) {
+    all_final = true;
+    for (size_t c = 0; c < w->bs_confs_size[iteration & 1]; c++) {
+      w->bs_confs[iteration & 1][c].successors = 0;
+      w->bs_confs[iteration & 1][c].merged = false;
+      all_final &= w->bs_confs[iteration & 1][c].conf.final();
+    }
 
-      // Extract nodes from the configuration
-      nodes.extract(bs_conf.conf, w->extracted_nodes);
-      w->extracted_embeddings.resize(w->extracted_nodes.size());
-      for (size_t i = 0; i < w->extracted_nodes.size(); i++)
-        w->extracted_embeddings[i] = w->extracted_nodes[i] >= 0 ? &w->embeddings[w->extracted_nodes[i]] : nullptr;
+    // If the budget cannot afford the beam search to finish, continue greedily
+    // from the best configuration, and if it cannot afford even the next step,
+    // finish the best configuration without the network
+    if (budget && !all_final) {
+      auto& bs_confs = w->bs_confs[iteration & 1];
+      auto& bs_confs_size = w->bs_confs_size[iteration & 1];
+      size_t best = 0, unfinished = 0;
+      for (size_t c = 0; c < bs_confs_size; c++) {
+        unfinished += !bs_confs[c].conf.final();
+        if (bs_confs[c].cost > bs_confs[best].cost) best = c;
+      }
 
-      // Classify using neural network
-      network.propagate(embeddings, w->extracted_embeddings, w->network_buffer, w->outcomes, &embeddings_cache);
+      auto& best_conf = bs_confs[best].conf;
+      if (search_beam_size > 1 && !budget->affords(search_beam_size * (2 * best_conf.buffer.size() + best_conf.stack.size()))) {
+        search_beam_size = 1;
+        degradation = DEGRADED_TO_GREEDY;
+      }
 
-      // Store all alternatives
-      for (unsigned i = 0; i < w->outcomes.size(); i++)
-        if (system->applicable(bs_conf.conf, i)) {
-          double cost = (bs_conf.cost * iteration + log(w->outcomes[i])) / (iteration + 1);
-          if (w->bs_alternatives.size() == beam_size) {
-            if (cost <= w->bs_alternatives[0].cost) continue;
-            pop_heap(w->bs_alternatives.begin(), w->bs_alternatives.end());
-            w->bs_alternatives.pop_back();
+      bool fallback = !budget->affords(search_beam_size > 1 ? unfinished : 1);
+      if (search_beam_size == 1 || fallback) {
+        if (best) swap(bs_confs[0], bs_confs[best]);
+        bs_confs_size = 1;
+        unfinished = !bs_confs[0].conf.final();
+      }
+
+      if (fallback) {
+        auto& bs_conf = bs_confs[0];
+        bs_conf.refresh_tree();
+        while (!bs_conf.conf.final()) {
+          unsigned transition = first_applicable(bs_conf.conf);
+          int child = system->perform(bs_conf.conf, transition);
+          if (child >= 0) {
+            bs_conf.heads[child] = t.nodes[child].head;
+            bs_conf.labels[child] = system->label(transition);
+          }
+        }
+        degradation = DEGRADED_TO_FALLBACK;
+        break;
+      }
+      budget->use(unfinished);
+    }
+
+    // Merge the unfinished configurations with identical features, which are the
+    // extracted nodes with their embeddings and the stack and buffer sizes,
+    // keeping only the one with the best cost
+    if (beam_recombination)
+      for (size_t c = 0; c < w->bs_confs_size[iteration & 1]; c++) {
+        auto& bs_conf = w->bs_confs[iteration & 1][c];
+        if (bs_conf.conf.final()) continue;
+
+        extract(bs_conf, &t, w->extracted_nodes);
+        bs_conf.signature.assign(w->extracted_nodes.begin(), w->extracted_nodes.end());
+        for (auto&& node : w->extracted_nodes)
+          bs_conf.signature.push_back(node >= 0 ? int(bs_conf.embeddings[node]) : -1);
+        bs_conf.signature.push_back(bs_conf.conf.stack.size());
+        bs_conf.signature.push_back(bs_conf.conf.buffer.size());
+
+        for (size_t o = 0; o < c; o++) {
+          auto& other = w->bs_confs[iteration & 1][o];
+          if (!other.conf.final() && !other.merged && other.signature == bs_conf.signature) {
+            (other.cost >= bs_conf.cost ? bs_conf : other).merged = true;
+            break;
           }
-          w->bs_alternatives.emplace_back(&bs_conf, i, cost);
-          push_heap(w->bs_alternatives.begin(), w->bs_alternatives.end());
         }
+      }
+
+    unsigned iteration_chunks = min(size_t(chunks), w->bs_confs_size[iteration & 1]);
+    if (iteration_chunks > 1) {
+      beam_workers->run(iteration_chunks, [&](unsigned chunk_index) { expand(chunk_index, iteration, iteration_chunks); });
+
+      // Merge the alternatives of the chunks deterministically, considering
+      // them in the order of their configurations and transitions
+      w->bs_alternatives.clear();
+      for (unsigned i = 0; i < iteration_chunks; i++)
+        w->bs_alternatives.insert(w->bs_alternatives.end(), w->bs_chunks[i].best.alternatives.begin(), w->bs_chunks[i].best.alternatives.end());
+      sort(w->bs_alternatives.begin(), w->bs_alternatives.end(), [](const workspace::beam_size_alternative& a, const workspace::beam_size_alternative& b) {
+        return a.bs_conf < b.bs_conf || (a.bs_conf == b.bs_conf && a.transition < b.transition);
+      });
+
+      w->bs_best.clear(search_beam_size);
+      for (auto&& alternative : w->bs_alternatives)
+        if (alternative.cost > w->bs_best.threshold())
+          w->bs_best.add(alternative.bs_conf, alternative.transition, alternative.cost);
+      w->bs_alternatives.swap(w->bs_best.alternatives);
+    } else {
+      expand(0, iteration, 1);
+      w->bs_alternatives.swap(w->bs_chunks[0].best.alternatives);
     }
 
+    // Create the successors, copying only the configurations with several of them
+    for (auto&& alternative : w->bs_alternatives)
+      alternative.bs_conf->successors++;
+
     w->bs_confs_size[(iteration + 1) & 1] = 0;
     for (auto&& alternative : w->bs_alternatives) {
       auto& bs_conf_new = w->bs_confs[(iteration + 1) & 1][w->bs_confs_size[(iteration + 1) & 1]++];
-      bs_conf_new = *alternative.bs_conf;
+      alternative.bs_conf->pass_to(bs_conf_new);
       bs_conf_new.cost = alternative.cost;
       if (alternative.transition >= 0) {
         bs_conf_new.refresh_tree();
-        system->perform(bs_conf_new.conf, alternative.transition);
-        bs_conf_new.save_tree();
+        int child = system->perform(bs_conf_new.conf, alternative.transition);
+
+        // If a node was linked, store the arc and use the embeddings of the node with the new deprel
+        if (child >= 0) {
+          int label = system->label(alternative.transition);
+          bs_conf_new.heads[child] = t.nodes[child].head;
+          bs_conf_new.labels[child] = label;
+
+          int& labeled = w->bs_embeddings_labeled[child * labels.size() + label];
+          if (labeled < 0) {
+            labeled = w->bs_embeddings_size++;
+            if (w->bs_embeddings.size() < w->bs_embeddings_size) w->bs_embeddings.resize(w->bs_embeddings_size);
+            w->bs_embeddings[labeled] = w->bs_embeddings[child];
+            embed_node_label(label, w->bs_embeddings[labeled]);
+          }
+          bs_conf_new.embeddings[child] = labeled;
+        }
       }
     }
   }
@@ -183,31 +479,153 @@ void parser_nn::parse_beam_search(tree& t, unsigned beam_size) const {
   for (size_t i = 1; i < w->bs_confs_size[iteration & 1]; i++)
     if (w->bs_confs[iteration & 1][i].cost > w->bs_confs[iteration & 1][best].cost)
       best = i;
-  w->bs_confs[iteration & 1][best].refresh_tree();
+  auto& bs_conf_best = w->bs_confs[iteration & 1][best];
+  bs_conf_best.refresh_tree();
+  for (size_t i = 0; i < t.nodes.size(); i++)
+    if (bs_conf_best.labels[i] >= 0)
+      t.nodes[i].deprel.assign(labels[bs_conf_best.labels[i]]);
+    else
+      t.nodes[i].deprel.clear();
+
+  // Store workspace, unless it retains more memory than allowed
+  if (workspace_memory && w->memory() > workspace_memory) delete w; else workspaces.push(w);
+
+  return degradation;
+}
 
-  // Store workspace
-  workspaces.push(w);
+unsigned parser_nn::first_applicable(const configuration& conf) const {
+  unsigned transition = 0;
+  while (!system->applicable(conf, transition)) transition++;
+  return transition;
+}
+
+template <class T>
+static inline size_t vector_memory(const vector<T>& v) {
+  return v.capacity() * sizeof(T);
+}
+
+static size_t tree_memory(const tree& t) {
+  size_t memory = vector_memory(t.nodes);
+  for (auto&& node : t.nodes)
+    memory += node.form.capacity() + node.lemma.capacity() + node.upostag.capacity() + node.xpostag.capacity() + node.feats.capacity() +
+        node.deprel.capacity() + node.deps.capacity() + node.misc.capacity() + vector_memory(node.children);
+  return memory;
+}
+
+size_t parser_nn::workspace::memory() const {
+  size_t memory = sizeof(workspace) + word.capacity() + word_buffer.capacity() + vector_memory(extracted_nodes) +
+      vector_memory(extracted_embeddings) + vector_memory(outcomes) + vector_memory(network_buffer) + vector_memory(quantized_buffer);
+
+  memory += vector_memory(greedy_states) + vector_memory(greedy_active) + vector_memory(greedy_batch) + vector_memory(greedy_masks);
+  for (auto&& state : greedy_states) {
+    memory += vector_memory(state.conf.stack) + vector_memory(state.conf.buffer) + vector_memory(state.embeddings) +
+        vector_memory(state.extracted_nodes) + vector_memory(state.extracted_embeddings) + state.applicable.capacity() / 8;
+    for (auto&& embedding : state.embeddings)
+      memory += vector_memory(embedding);
+  }
+
+  for (auto&& bs_confs_part : bs_confs) {
+    memory += vector_memory(bs_confs_part);
+    for (auto&& bs_conf : bs_confs_part)
+      memory += vector_memory(bs_conf.conf.stack) + vector_memory(bs_conf.conf.buffer) + vector_memory(bs_conf.heads) +
+          vector_memory(bs_conf.labels) + vector_memory(bs_conf.embeddings) + vector_memory(bs_conf.extracted_embeddings) +
+          vector_memory(bs_conf.signature);
+  }
+  memory += vector_memory(bs_best.alternatives) + vector_memory(bs_alternatives) + vector_memory(bs_chunks);
+  for (auto&& chunk : bs_chunks)
+    memory += tree_memory(chunk.t) + vector_memory(chunk.extracted_nodes) + vector_memory(chunk.batch) + vector_memory(chunk.outcomes) +
+        vector_memory(chunk.network_buffer) + vector_memory(chunk.quantized_buffer) + vector_memory(chunk.candidates) + vector_memory(chunk.best.alternatives);
+  memory += vector_memory(bs_embeddings) + vector_memory(bs_embeddings_labeled);
+  for (auto&& embedding : bs_embeddings)
+    memory += vector_memory(embedding);
+
+  return memory;
+}
+
+void parser_nn::workspace::beam_size_best::clear(unsigned beam_size) {
+  alternatives.clear();
+  this->beam_size = beam_size;
+}
+
+double parser_nn::workspace::beam_size_best::threshold() const {
+  return alternatives.size() < beam_size ? -numeric_limits<double>::infinity() : alternatives[worst].cost;
+}
+
+void parser_nn::workspace::beam_size_best::add(beam_size_configuration* bs_conf, int transition, double cost) {
+  if (alternatives.size() < beam_size)
+    alternatives.emplace_back(bs_conf, transition, cost);
+  else
+    alternatives[worst] = beam_size_alternative(bs_conf, transition, cost);
+
+  // Find the worst alternative once all beam_size alternatives are present
+  if (alternatives.size() == beam_size) {
+    worst = 0;
+    for (size_t i = 1; i < alternatives.size(); i++)
+      if (alternatives[i].cost < alternatives[worst].cost)
+        worst = i;
+  }
 }
 
 void parser_nn::workspace::beam_size_configuration::refresh_tree() {
   for (auto&& node : conf.t->nodes) node.children.clear();
   for (size_t i = 0; i < conf.t->nodes.size(); i++) {
     conf.t->nodes[i].head = heads[i];
-    conf.t->nodes[i].deprel = deprels[i];
     if (heads[i] >= 0) conf.t->nodes[heads[i]].children.push_back(i);
   }
 }
 
-void parser_nn::workspace::beam_size_configuration::save_tree() {
-  if (conf.t->nodes.size() > heads.size()) heads.resize(conf.t->nodes.size());
-  if (conf.t->nodes.size() > deprels.size()) deprels.resize(conf.t->nodes.size());
-  for (size_t i = 0; i < conf.t->nodes.size(); i++) {
-    heads[i] = conf.t->nodes[i].head;
-    deprels[i] = conf.t->nodes[i].deprel;
+void parser_nn::workspace::beam_size_configuration::pass_to(beam_size_configuration& successor) {
+  successor.conf.t = conf.t;
+  if (--successors) {
+    successor.conf.stack = conf.stack;
+    successor.conf.buffer = conf.buffer;
+    successor.heads = heads;
+    successor.labels = labels;
+    successor.embeddings = embeddings;
+  } else {
+    successor.conf.stack.swap(conf.stack);
+    successor.conf.buffer.swap(conf.buffer);
+    successor.heads.swap(heads);
+    successor.labels.swap(labels);
+    successor.embeddings.swap(embeddings);
   }
 }
 
-void parser_nn::load(binary_decoder& data, unsigned cache) {
+bool parser_nn::save_embeddings_cache(ostream& os) const {
+  return embeddings_cache.save(os, network.fingerprint(embeddings));
+}
+
+void parser_nn::embeddings_words(vector<unsigned>& words) const {
+  words.assign(embeddings.size(), 0);
+  for (unsigned i = 0; i < embeddings.size(); i++)
+    while (embeddings[i].weight(words[i])) words[i]++;
+}
+
+void parser_nn::embed_node(const node& n, vector<int>& embedding_ids, string& word, string& buffer) const {
+  embedding_ids.resize(embeddings.size());
+  for (size_t i = 0; i < embeddings.size(); i++) {
+    values[i].extract(n, word);
+    embedding_ids[i] = embeddings[i].lookup_word(word, buffer);
+  }
+}
+
+void parser_nn::embed_node_label(int label, vector<int>& embedding_ids) const {
+  // Only the values using deprel change, and their embeddings were precomputed for all labels
+  for (unsigned i = 0; i < deprel_values.size(); i++)
+    embedding_ids[deprel_values[i]] = deprel_embeddings[i][label];
+}
+
+void parser_nn::start_embeddings_profile() {
+  vector<unsigned> words;
+  embeddings_words(words);
+  embeddings_profile.init(words);
+}
+
+bool parser_nn::save_embeddings_profile(ostream& os) const {
+  return !embeddings_profile.empty() && embeddings_profile.save(os);
+}
+
+void parser_nn::load(binary_decoder& data, const load_options& options) {
   string description, error;
 
   version = versioned ? data.next_1B() : 1;
@@ -244,10 +662,69 @@ void parser_nn::load(binary_decoder& data, unsigned cache) {
   for (auto&& embedding : embeddings)
     embedding.load(data);
 
+  // Precompute the embeddings of all labels for the values using deprel
+  deprel_values.clear();
+  deprel_embeddings.clear();
+  for (unsigned i = 0; i < values.size(); i++)
+    if (values[i].uses_deprel()) {
+      deprel_values.push_back(i);
+      deprel_embeddings.emplace_back();
+      for (auto&& label : labels)
+        deprel_embeddings.back().push_back(embeddings[i].lookup_word(label, description));
+    }
+
   // Load the network
   network.load(data);
   network.generate_tanh_cache();
-  network.generate_embeddings_cache(embeddings, embeddings_cache, cache);
+  if (options.quantized) network.quantize();
+
+  beam_recombination = options.beam_recombination;
+  beam_min_length = options.beam_min_length;
+  beam_max_length = options.beam_max_length;
+  beam_margin = options.beam_margin;
+
+  // Configure the cached workspaces
+  workspaces.resize(options.workspaces);
+  workspace_memory = size_t(options.workspace_memory) << 20;
+
+  // Start the workers expanding the beam search configurations
+  beam_workers.reset(options.beam_threads > 1 ? new worker_pool(options.beam_threads) : nullptr);
+
+  // Map or generate the embeddings cache
+  auto cache_precision = options.quantized ? neural_network::embeddings_cache::INT8 : neural_network::embeddings_cache::FLOAT32;
+  switch (options.cache_precision) {
+    case load_options::DEFAULT_PRECISION: break;
+    case load_options::FLOAT32: cache_precision = neural_network::embeddings_cache::FLOAT32; break;
+    case load_options::FLOAT16: cache_precision = neural_network::embeddings_cache::FLOAT16; break;
+    case load_options::BFLOAT16: cache_precision = neural_network::embeddings_cache::BFLOAT16; break;
+    case load_options::INT8: cache_precision = neural_network::embeddings_cache::INT8; break;
+  }
+  if (!options.cache_file.empty()) {
+    if (!embeddings_cache.map(options.cache_file.c_str(), network.fingerprint(embeddings)))
+      throw binary_decoder_error("Cannot map the embeddings cache file");
+    // The precision of the cache file is used, unless a different one was requested explicitly
+    if (options.cache_precision != load_options::DEFAULT_PRECISION && embeddings_cache.precision != cache_precision)
+      throw binary_decoder_error("The embeddings cache file precision differs from the requested one");
+  } else {
+    if (options.cache_lazy) {
+      network.generate_lazy_embeddings_cache(embeddings, embeddings_cache, options.cache, cache_precision, size_t(options.cache_memory) << 20);
+    } else if (!options.cache_profile.empty()) {
+      neural_network::embeddings_profile profile;
+      ifstream profile_file(path_from_utf8(options.cache_profile).c_str(), ifstream::in | ifstream::binary);
+      if (!profile_file.is_open() || !profile.load(profile_file))
+        throw binary_decoder_error("Cannot load the embeddings cache profile");
+
+      vector<unsigned> words;
+      embeddings_words(words);
+      if (profile.profiled_words() != words)
+        throw binary_decoder_error("The embeddings cache profile does not match the model");
+
+      network.generate_embeddings_cache(embeddings, embeddings_cache, options.cache, cache_precision, options.cache_threads,
+                                        &profile, size_t(options.cache_memory) << 20);
+    } else {
+      network.generate_embeddings_cache(embeddings, embeddings_cache, options.cache, cache_precision, options.cache_threads);
+    }
+  }
 }
 
 } // namespace parsito
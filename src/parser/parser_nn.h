@@ -18,7 +18,8 @@
 #include "network/neural_network.h"
 #include "parser.h"
 #include "transition/transition_system.h"
-#include "utils/threadsafe_stack.h"
+#include "worker_pool.h"
+#include "workspace_cache.h"
 
 namespace ufal {
 namespace parsito {
@@ -28,14 +29,36 @@ class parser_nn : public parser {
   parser_nn(bool versioned);
 
   virtual void parse(tree& t, unsigned beam_size = 0) const override;
+  virtual void parse_batch(vector<tree>& trees, unsigned beam_size = 0) const override;
+  virtual degradation_t parse(tree& t, unsigned beam_size, const parse_budget& budget) const override;
+  virtual void trim_memory() const override;
+
+  // Parse greedily, returning for every tree the smallest difference between the
+  // probabilities of the two best applicable transitions of all its decisions.
+  float parse_margin(tree& t) const;
+  void parse_batch_margins(vector<tree>& trees, vector<float>& margins) const;
+
+  // Save the embeddings cache, so that it can be mapped using load_options::cache_file.
+  bool save_embeddings_cache(ostream& os) const;
+
+  // Record the embedding lookups of the subsequent parses, so that the profile
+  // can be saved and used to select the cached words by load_options::cache_profile.
+  void start_embeddings_profile();
+  bool save_embeddings_profile(ostream& os) const;
 
  protected:
-  virtual void load(binary_decoder& data, unsigned cache) override;
+  virtual void load(binary_decoder& data, const load_options& options) override;
 
  private:
   friend class parser_nn_trainer;
-  void parse_greedy(tree& t) const;
-  void parse_beam_search(tree& t, unsigned beam_size) const;
+  class budget_tracker;
+  degradation_t parse_greedy(tree* trees, unsigned count, budget_tracker* budget = nullptr, float* margins = nullptr) const;
+  degradation_t parse_beam_search(tree& t, unsigned beam_size, budget_tracker* budget = nullptr) const;
+  bool beam_search_length(const tree& t) const;
+  unsigned first_applicable(const configuration& conf) const;
+  void embeddings_words(vector<unsigned>& words) const;
+  void embed_node(const node& n, vector<int>& embedding_ids, string& word, string& buffer) const;
+  void embed_node_label(int label, vector<int>& embedding_ids) const;
 
   bool versioned;
   unsigned version;
@@ -49,49 +72,100 @@ class parser_nn : public parser {
 
   vector<value_extractor> values;
   vector<embedding> embeddings;
+  vector<unsigned> deprel_values;
+  vector<vector<int>> deprel_embeddings;
 
   neural_network network;
   neural_network::embeddings_cache embeddings_cache;
+  neural_network::embeddings_profile embeddings_profile;
+  bool beam_recombination;
+  unsigned beam_min_length, beam_max_length;
+  float beam_margin;
+  unique_ptr<worker_pool> beam_workers;
+  size_t workspace_memory;
 
   struct workspace {
-    workspace(bool single_root) : conf(single_root) {}
-
-    configuration conf;
+    // Estimate of the memory retained by the workspace buffers
+    size_t memory() const;
 
     string word, word_buffer;
-    vector<vector<int>> embeddings;
-    vector<vector<string>> embeddings_values;
 
     vector<int> extracted_nodes;
     vector<const vector<int>*> extracted_embeddings;
 
     vector<float> outcomes, network_buffer;
+    vector<int8_t> quantized_buffer;
+
+    // Greedy structures, one state for every tree parsed in lockstep
+    struct greedy_state {
+      greedy_state(bool single_root) : conf(single_root) {}
 
-    // Beam-size structures
+      configuration conf;
+      vector<vector<int>> embeddings;
+      vector<int> extracted_nodes;
+      vector<const vector<int>*> extracted_embeddings;
+      vector<bool> applicable;
+    };
+    vector<greedy_state> greedy_states;
+    vector<unsigned> greedy_active;
+    vector<const vector<const vector<int>*>*> greedy_batch;
+    vector<const vector<bool>*> greedy_masks;
+
+    // Beam-size structures. The configurations store the arcs using label ids
+    // and refer to the node embeddings in bs_embeddings, which are shared by
+    // all configurations. A configuration with a single successor passes its
+    // vectors to it, only configurations with several successors are copied.
     struct beam_size_configuration {
       beam_size_configuration(bool single_root) : conf(single_root) {}
 
       configuration conf;
       vector<int> heads;
-      vector<string> deprels;
+      vector<int> labels;
+      vector<unsigned> embeddings;
+      vector<const vector<int>*> extracted_embeddings;
+      vector<int> signature;
       double cost;
+      unsigned successors;
+      bool merged;
 
       void refresh_tree();
-      void save_tree();
+      void pass_to(beam_size_configuration& successor);
     };
     struct beam_size_alternative {
-      const beam_size_configuration* bs_conf;
+      beam_size_configuration* bs_conf;
       int transition;
       double cost;
-      bool operator<(const beam_size_alternative& other) const { return cost > other.cost; }
 
-      beam_size_alternative(const beam_size_configuration* bs_conf, int transition, double cost)
+      beam_size_alternative(beam_size_configuration* bs_conf, int transition, double cost)
           : bs_conf(bs_conf), transition(transition), cost(cost) {}
     };
+    // The beam_size best alternatives, stored unordered with the worst one tracked
+    struct beam_size_best {
+      vector<beam_size_alternative> alternatives;
+      unsigned beam_size;
+      size_t worst;
+
+      void clear(unsigned beam_size);
+      double threshold() const;
+      void add(beam_size_configuration* bs_conf, int transition, double cost);
+    };
     vector<beam_size_configuration> bs_confs[2]; size_t bs_confs_size[2];
+    beam_size_best bs_best;
     vector<beam_size_alternative> bs_alternatives;
+    struct beam_size_chunk {
+      tree t;
+      vector<int> extracted_nodes;
+      vector<const vector<const vector<int>*>*> batch;
+      vector<float> outcomes, network_buffer;
+      vector<int8_t> quantized_buffer;
+      vector<unsigned> candidates;
+      beam_size_best best;
+    };
+    vector<beam_size_chunk> bs_chunks;
+    vector<vector<int>> bs_embeddings; size_t bs_embeddings_size;
+    vector<int> bs_embeddings_labeled;
   };
-  mutable threadsafe_stack<workspace> workspaces;
+  mutable workspace_cache<workspace> workspaces;
 };
 
 } // namespace parsito
@@ -13,6 +13,7 @@
 #include <limits>
 #include <random>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "network/neural_network_trainer.h"
@@ -280,6 +281,7 @@ void parser_nn_trainer::train(const string& transition_system_name, const string
       vector<const vector<int>*>  extracted_embeddings_eval;
       vector<unsigned> transitions_eval;
       vector<float> hidden_layer_eval, outcomes_eval;
+      vector<int8_t> quantized_hidden_layer_eval;
 
       for (unsigned current_index; (current_index = atomic_index++) < permutation.size();) {
         const tree& gold = train[permutation[current_index]];
@@ -402,7 +404,7 @@ void parser_nn_trainer::train(const string& transition_system_name, const string
                   extracted_embeddings_eval[i] = extracted_nodes_eval[i] >= 0 ? &nodes_embeddings_eval[extracted_nodes_eval[i]] : nullptr;
 
                 // Classify using neural network
-                parser.network.propagate(parser.embeddings, extracted_embeddings_eval, hidden_layer_eval, outcomes_eval, nullptr, false);
+                parser.network.propagate(parser.embeddings, extracted_embeddings_eval, hidden_layer_eval, quantized_hidden_layer_eval, outcomes_eval, nullptr, false);
 
                 // Find most probable applicable transition
                 int network_best = -1;
@@ -0,0 +1,74 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+
+#include "worker_pool.h"
+
+namespace ufal {
+namespace parsito {
+
+worker_pool::worker_pool(unsigned threads) : stop(false) {
+  for (unsigned i = 1; i < threads; i++)
+    workers.emplace_back(&worker_pool::work, this);
+}
+
+worker_pool::~worker_pool() {
+  {
+    lock_guard<mutex> lock(jobs_mutex);
+    stop = true;
+  }
+  jobs_available.notify_all();
+  for (auto&& worker : workers)
+    worker.join();
+}
+
+void worker_pool::run(unsigned tasks, const function<void(unsigned)>& task) {
+  if (!tasks) return;
+
+  job current = {&task, tasks, 0, 0};
+  unique_lock<mutex> lock(jobs_mutex);
+  if (tasks > 1 && !workers.empty()) {
+    jobs.push_back(&current);
+    jobs_available.notify_all();
+  }
+
+  // Run the tasks not yet taken by the workers
+  while (current.started < current.tasks) {
+    unsigned index = current.started++;
+    if (current.started == current.tasks && tasks > 1 && !workers.empty())
+      jobs.erase(find(jobs.begin(), jobs.end(), &current));
+    lock.unlock();
+    task(index);
+    lock.lock();
+    current.finished++;
+  }
+
+  // Wait for the tasks run by the workers
+  job_finished.wait(lock, [&current]{ return current.finished == current.tasks; });
+}
+
+void worker_pool::work() {
+  unique_lock<mutex> lock(jobs_mutex);
+  while (true) {
+    jobs_available.wait(lock, [this]{ return stop || !jobs.empty(); });
+    if (stop) return;
+
+    job* current = jobs.front();
+    unsigned index = current->started++;
+    if (current->started == current->tasks) jobs.pop_front();
+    lock.unlock();
+    (*current->task)(index);
+    lock.lock();
+    if (++current->finished == current->tasks) job_finished.notify_all();
+  }
+}
+
+} // namespace parsito
+} // namespace ufal
@@ -0,0 +1,52 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "common.h"
+
+namespace ufal {
+namespace parsito {
+
+// Persistent worker threads running the tasks of possibly several concurrent
+// callers. The calling thread also runs the tasks of its own call.
+class worker_pool {
+ public:
+  worker_pool(unsigned threads);
+  ~worker_pool();
+
+  // Number of threads running the tasks, including the calling thread.
+  unsigned threads() const { return workers.size() + 1; }
+
+  // Run task(0), ..., task(tasks - 1) and return when all have finished.
+  void run(unsigned tasks, const function<void(unsigned)>& task);
+
+ private:
+  struct job {
+    const function<void(unsigned)>* task;
+    unsigned tasks, started, finished;
+  };
+
+  void work();
+
+  vector<thread> workers;
+  deque<job*> jobs;
+  bool stop;
+  mutex jobs_mutex;
+  condition_variable jobs_available, job_finished;
+};
+
+} // namespace parsito
+} // namespace ufal
@@ -0,0 +1,129 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <thread>
+
+#include "common.h"
+
+namespace ufal {
+namespace parsito {
+
+//
+// Declarations
+//
+
+// Lock-free cache of workspaces. Every thread has a home slot, which it uses
+// when retrieving and storing its workspace, so that without contention a
+// thread keeps reusing the same workspace and touches only its own cache line.
+// If the home slot is empty or occupied, the other slots are tried, so the
+// workspaces of finished threads are reused by new ones. The number of slots
+// bounds the number of cached workspaces; when all slots are occupied, the
+// pushed workspace is deallocated.
+template <class T>
+class workspace_cache {
+ public:
+  inline workspace_cache(unsigned size = 0);
+  inline ~workspace_cache();
+
+  // Change the number of slots, 0 meaning twice the number of hardware threads.
+  // Not thread-safe, must not be called concurrently with other methods.
+  inline void resize(unsigned size);
+  // Deallocate all cached workspaces; can be called concurrently with pop and push.
+  inline void clear();
+
+  inline T* pop();
+  inline void push(T* t);
+
+ private:
+  enum { CACHE_LINE = 64 };
+  struct slot {
+    atomic<T*> item;
+    char padding[CACHE_LINE - sizeof(atomic<T*>)];
+  };
+  unique_ptr<char[]> storage;
+  slot* slots;
+  unsigned size;
+
+  inline static unsigned thread_index();
+};
+
+//
+// Definitions
+//
+
+template <class T>
+workspace_cache<T>::workspace_cache(unsigned size) : slots(nullptr), size(0) {
+  resize(size);
+}
+
+template <class T>
+workspace_cache<T>::~workspace_cache() {
+  clear();
+}
+
+template <class T>
+void workspace_cache<T>::resize(unsigned size) {
+  clear();
+
+  this->size = size ? size : max(2 * thread::hardware_concurrency(), 16U);
+
+  // Align the slots to the cache line size, so that every slot occupies a separate cache line
+  storage.reset(new char[sizeof(slot) * this->size + CACHE_LINE]);
+  slots = (slot*)((uintptr_t(storage.get()) + CACHE_LINE - 1) & ~uintptr_t(CACHE_LINE - 1));
+  for (unsigned i = 0; i < this->size; i++) {
+    new (&slots[i]) slot();
+    slots[i].item.store(nullptr, memory_order_relaxed);
+  }
+}
+
+template <class T>
+void workspace_cache<T>::clear() {
+  for (unsigned i = 0; i < size; i++)
+    delete slots[i].item.exchange(nullptr, memory_order_acquire);
+}
+
+template <class T>
+T* workspace_cache<T>::pop() {
+  for (unsigned i = 0, index = thread_index() % size; i < size; i++, index = index + 1 < size ? index + 1 : 0) {
+    atomic<T*>& item = slots[index].item;
+    if (item.load(memory_order_relaxed)) {
+      T* t = item.exchange(nullptr, memory_order_acquire);
+      if (t) return t;
+    }
+  }
+  return nullptr;
+}
+
+template <class T>
+void workspace_cache<T>::push(T* t) {
+  for (unsigned i = 0, index = thread_index() % size; i < size; i++, index = index + 1 < size ? index + 1 : 0) {
+    atomic<T*>& item = slots[index].item;
+    T* empty = nullptr;
+    if (!item.load(memory_order_relaxed) && item.compare_exchange_strong(empty, t, memory_order_release, memory_order_relaxed))
+      return;
+  }
+
+  // All slots are occupied, the workspace is deallocated.
+  delete t;
+}
+
+template <class T>
+unsigned workspace_cache<T>::thread_index() {
+  static atomic<unsigned> threads(0);
+  static thread_local unsigned index = threads.fetch_add(1, memory_order_relaxed);
+  return index;
+}
+
+} // namespace parsito
+} // namespace ufal
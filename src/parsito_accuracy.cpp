@@ -11,6 +11,7 @@
 #include "parser/parser.h"
 #include "utils/iostreams.h"
 #include "utils/options.h"
+#include "utils/parse_double.h"
 #include "utils/parse_int.h"
 #include "tree/tree_format.h"
 #include "version/version.h"
@@ -23,6 +24,18 @@ int main(int argc, char* argv[]) {
   options::map options;
   if (!options::parse({{"input", options::value{"conllu"}},
                        {"beam_size", options::value::any},
+                       {"beam_threads", options::value::any},
+                       {"beam_recombination", options::value::none},
+                       {"beam_min_length", options::value::any},
+                       {"beam_max_length", options::value::any},
+                       {"beam_margin", options::value::any},
+                       {"cache_file", options::value::any},
+                       {"cache_precision", options::value{"float32", "float16", "bfloat16", "int8"}},
+                       {"cache_threads", options::value::any},
+                       {"cache_lazy", options::value::none},
+                       {"cache_memory", options::value::any},
+                       {"cache_profile", options::value::any},
+                       {"quantize", options::value::none},
                        {"version", options::value::none},
                        {"help", options::value::none}}, argc, argv, options) ||
       options.count("help") ||
@@ -30,6 +43,18 @@ int main(int argc, char* argv[]) {
     runtime_failure("Usage: " << argv[0] << " [options] model_file\n"
                     "Options: --input=conllu\n"
                     "         --beam_size=beam size during decoding\n"
+                    "         --beam_threads=threads expanding the beam of a sentence\n"
+                    "         --beam_recombination (merge beam configurations with identical features)\n"
+                    "         --beam_min_length=minimum sentence length for beam search\n"
+                    "         --beam_max_length=maximum sentence length for beam search\n"
+                    "         --beam_margin=use beam search only for greedy decisions with smaller margin\n"
+                    "         --cache_file=embeddings cache file created by parsito_cache\n"
+                    "         --cache_precision=float32|float16|bfloat16|int8\n"
+                    "         --cache_threads=threads used to compute the cache\n"
+                    "         --cache_lazy (compute the cache on first use)\n"
+                    "         --cache_memory=maximum lazy or profiled cache size in MB\n"
+                    "         --cache_profile=cache the words most frequent in given profile\n"
+                    "         --quantize (use int8 quantized network)\n"
                     "         --version\n"
                     "         --help");
   if (options.count("version"))
@@ -43,8 +68,53 @@ int main(int argc, char* argv[]) {
   int beam_size = options.count("beam_size") ? parse_int(options["beam_size"], "beam_size") : 0;
   if (beam_size < 0) runtime_failure("Beam size cannot be negative!");
 
+  parser::load_options load_options;
+  load_options.quantized = options.count("quantize");
+  if (options.count("cache_file")) load_options.cache_file = options["cache_file"];
+  if (options.count("beam_threads")) {
+    int beam_threads = parse_int(options["beam_threads"], "beam_threads");
+    if (beam_threads <= 0) runtime_failure("The number of beam threads must be positive!");
+    load_options.beam_threads = beam_threads;
+  }
+  load_options.beam_recombination = options.count("beam_recombination");
+  if (options.count("beam_min_length")) {
+    int beam_min_length = parse_int(options["beam_min_length"], "beam_min_length");
+    if (beam_min_length < 0) runtime_failure("The minimum beam search sentence length cannot be negative!");
+    load_options.beam_min_length = beam_min_length;
+  }
+  if (options.count("beam_max_length")) {
+    int beam_max_length = parse_int(options["beam_max_length"], "beam_max_length");
+    if (beam_max_length < 0) runtime_failure("The maximum beam search sentence length cannot be negative!");
+    load_options.beam_max_length = beam_max_length;
+  }
+  if (options.count("beam_margin")) {
+    load_options.beam_margin = parse_double(options["beam_margin"], "beam_margin");
+    if (load_options.beam_margin < 0) runtime_failure("The beam search margin cannot be negative!");
+  }
+  if (options.count("cache_threads")) {
+    int cache_threads = parse_int(options["cache_threads"], "cache_threads");
+    if (cache_threads <= 0) runtime_failure("The number of cache threads must be positive!");
+    load_options.cache_threads = cache_threads;
+  }
+  if (options.count("cache_lazy")) {
+    load_options.cache = parser::FULL_CACHE;
+    load_options.cache_lazy = true;
+  }
+  if (options.count("cache_memory")) {
+    int cache_memory = parse_int(options["cache_memory"], "cache_memory");
+    if (cache_memory < 0) runtime_failure("The cache memory limit cannot be negative!");
+    load_options.cache_memory = cache_memory;
+  }
+  if (options.count("cache_profile")) load_options.cache_profile = options["cache_profile"];
+  if (options.count("cache_precision")) {
+    const string& precision = options["cache_precision"];
+    load_options.cache_precision = precision == "float32" ? parser::load_options::FLOAT32 :
+        precision == "float16" ? parser::load_options::FLOAT16 :
+        precision == "bfloat16" ? parser::load_options::BFLOAT16 : parser::load_options::INT8;
+  }
+
   cerr << "Loading parser: ";
-  unique_ptr<parser> p(parser::load(argv[1]));
+  unique_ptr<parser> p(parser::load(argv[1], load_options));
   if (!p)
     runtime_failure("Cannot load parser from file '" << argv[1] << "'!");
   cerr << "done" << endl;
@@ -14,6 +14,7 @@
 #include "parsito_service.h"
 #include "utils/iostreams.h"
 #include "utils/options.h"
+#include "utils/parse_double.h"
 #include "utils/parse_int.h"
 #include "utils/path_from_utf8.h"
 #include "version/version.h"
@@ -61,12 +62,29 @@ int main(int argc, char* argv[]) {
 
   options::map options;
   if (!options::parse({{"daemon",options::value::none},
+                       {"cascade_models", options::value::none},
+                       {"beam_min_length", options::value::any},
+                       {"beam_max_length", options::value::any},
+                       {"beam_margin", options::value::any},
+                       {"workspaces", options::value::any},
+                       {"workspace_memory", options::value::any},
+                       {"time_limit", options::value::any},
                        {"version", options::value::none},
                        {"help", options::value::none}}, argc, argv, options) ||
       options.count("help") ||
-      ((argc < 2 || (argc % 4) != 2) && !options.count("version")))
+      ((argc < 2 || (argc - 2) % (options.count("cascade_models") ? 6 : 4)) && !options.count("version")))
     runtime_failure("Usage: " << argv[0] << " [options] port (model_name model_file acknowledgements beam_size)*\n"
+                    "With --cascade_models, every model description continues with\n"
+                    "cascade_model_file cascade_margin, the large model reparsing sentences with\n"
+                    "smaller greedy margin of the model_file; an empty cascade_model_file means no cascade.\n"
                     "Options: --daemon\n"
+                    "         --cascade_models (model descriptions contain cascade_model_file cascade_margin)\n"
+                    "         --beam_min_length=minimum sentence length for beam search\n"
+                    "         --beam_max_length=maximum sentence length for beam search\n"
+                    "         --beam_margin=use beam search only for greedy decisions with smaller margin\n"
+                    "         --workspaces=maximum number of cached parsing workspaces\n"
+                    "         --workspace_memory=maximum memory in MB kept by a workspace\n"
+                    "         --time_limit=maximum parsing time of a request in seconds\n"
                     "         --version\n"
                     "         --help");
   if (options.count("version")) {
@@ -83,12 +101,55 @@ int main(int argc, char* argv[]) {
   if (options.count("daemon")) runtime_failure("The --daemon option is currently supported on Linux only!");
 #endif
 
+  parser::load_options load_options;
+  if (options.count("beam_min_length")) {
+    int beam_min_length = parse_int(options["beam_min_length"], "beam_min_length");
+    if (beam_min_length < 0) runtime_failure("The minimum beam search sentence length cannot be negative!");
+    load_options.beam_min_length = beam_min_length;
+  }
+  if (options.count("beam_max_length")) {
+    int beam_max_length = parse_int(options["beam_max_length"], "beam_max_length");
+    if (beam_max_length < 0) runtime_failure("The maximum beam search sentence length cannot be negative!");
+    load_options.beam_max_length = beam_max_length;
+  }
+  if (options.count("beam_margin")) {
+    load_options.beam_margin = parse_double(options["beam_margin"], "beam_margin");
+    if (load_options.beam_margin < 0) runtime_failure("The beam search margin cannot be negative!");
+  }
+  if (options.count("workspaces")) {
+    int workspaces = parse_int(options["workspaces"], "workspaces");
+    if (workspaces < 0) runtime_failure("The number of cached workspaces cannot be negative!");
+    load_options.workspaces = workspaces;
+  }
+  if (options.count("workspace_memory")) {
+    int workspace_memory = parse_int(options["workspace_memory"], "workspace_memory");
+    if (workspace_memory < 0) runtime_failure("The workspace memory limit cannot be negative!");
+    load_options.workspace_memory = workspace_memory;
+  }
+
+  double time_limit = 0;
+  if (options.count("time_limit")) {
+    time_limit = parse_double(options["time_limit"], "time_limit");
+    if (time_limit <= 0) runtime_failure("The time limit must be positive!");
+  }
+
   // Initialize the service
   vector<parsito_service::model_description> models;
-  for (int i = 2; i < argc; i += 4)
-    models.emplace_back(argv[i], argv[i + 1], argv[i + 2], parse_int(argv[i + 3], "beam size"));
+  if (options.count("cascade_models")) {
+    for (int i = 2; i < argc; i += 6) {
+      double cascade_margin = 0;
+      if (*argv[i + 4]) {
+        cascade_margin = parse_double(argv[i + 5], "cascade margin");
+        if (cascade_margin <= 0) runtime_failure("The cascade margin must be positive!");
+      }
+      models.emplace_back(argv[i], argv[i + 1], argv[i + 2], parse_int(argv[i + 3], "beam size"), argv[i + 4], cascade_margin);
+    }
+  } else {
+    for (int i = 2; i < argc; i += 4)
+      models.emplace_back(argv[i], argv[i + 1], argv[i + 2], parse_int(argv[i + 3], "beam size"));
+  }
 
-  if (!service.init(models))
+  if (!service.init(models, load_options, time_limit))
     runtime_failure("Cannot load specified models!");
 
   // Open log file
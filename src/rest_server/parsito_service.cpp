@@ -7,20 +7,28 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
+#include <chrono>
+
 #include "parsito_service.h"
+#include "parser/parser_cascade.h"
+#include "utils/parse_double.h"
 
 namespace ufal {
 namespace parsito {
 
 // Init the Parsito service -- load the models
-bool parsito_service::init(const vector<model_description>& model_descriptions) {
+bool parsito_service::init(const vector<model_description>& model_descriptions, const Parser::load_options& options, double time_limit) {
   if (model_descriptions.empty()) return false;
+  this->time_limit = time_limit;
 
   // Load models
   models.clear();
   rest_models_map.clear();
   for (auto& model_description : model_descriptions) {
-    Parser* parser = parser::load(model_description.file.c_str());
+    Parser* parser = model_description.cascade_file.empty() ?
+        parser::load(model_description.file.c_str(), options) :
+        parser_cascade::load(model_description.file.c_str(), model_description.cascade_file.c_str(), model_description.cascade_margin,
+                             parser_cascade::small_load_options(options), options);
     if (!parser) return false;
 
     // Store the model
@@ -111,6 +119,7 @@ bool parsito_service::handle_rest_parse(microrestd::rest_request& req) {
 
   unique_ptr<tree_input_format> input_format(get_input_format(req, error)); if (!input_format) return req.respond_error(error);
   unique_ptr<tree_output_format> output_format(get_output_format(req, error)); if (!output_format) return req.respond_error(error);
+  double time_limit; if (!get_time_limit(req, time_limit, error)) return req.respond_error(error);
 
   // Try loading all input trees
   input_format->set_text(data);
@@ -121,18 +130,27 @@ bool parsito_service::handle_rest_parse(microrestd::rest_request& req) {
 
   class generator : public rest_response_generator {
    public:
-    generator(const model_info* model, const char* data, tree_input_format* input_format, tree_output_format* output_format)
-        : rest_response_generator(model), input_format(input_format), output_format(output_format) {
+    generator(const model_info* model, const char* data, tree_input_format* input_format, tree_output_format* output_format, double time_limit)
+        : rest_response_generator(model), input_format(input_format), output_format(output_format),
+        time_limit(time_limit), start(chrono::steady_clock::now()), degraded(0) {
       input_format->set_text(data);
     }
 
     bool generate() {
       if (!input_format->next_tree(t)) {
+        if (time_limit > 0) json.indent().key("degraded").indent().value(int(degraded));
         json.finish(true);
         return false;
       }
 
-      model->parser->parse(t, model->beam_size);
+      if (time_limit > 0) {
+        // Parse within the remaining time; when no time remains, use a tiny
+        // positive limit, so that the parse is degraded right away
+        double remaining = time_limit - chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        degraded += model->parser->parse(t, model->beam_size, Parser::parse_budget(0, max(remaining, 1e-9))) != Parser::NOT_DEGRADED;
+      } else {
+        model->parser->parse(t, model->beam_size);
+      }
 
       output_format->write_tree(t, output, input_format.get());
       json.value(output, true);
@@ -146,8 +164,12 @@ bool parsito_service::handle_rest_parse(microrestd::rest_request& req) {
 
     unique_ptr<tree_input_format> input_format;
     unique_ptr<tree_output_format> output_format;
+
+    double time_limit;
+    chrono::steady_clock::time_point start;
+    unsigned degraded;
   };
-  return req.respond(generator::mime, new generator(model, data, input_format.release(), output_format.release()));
+  return req.respond(generator::mime, new generator(model, data, input_format.release(), output_format.release(), time_limit));
 }
 
 // REST service helpers
@@ -166,6 +188,19 @@ const char* parsito_service::get_data(microrestd::rest_request& req, string& err
   return data_it->second.c_str();
 }
 
+bool parsito_service::get_time_limit(microrestd::rest_request& req, double& time_limit, string& error) {
+  time_limit = this->time_limit;
+
+  auto time_limit_it = req.params.find("time_limit");
+  if (time_limit_it != req.params.end()) {
+    double requested;
+    if (!parse_double(time_limit_it->second, "time_limit", requested, error)) return error.push_back('\n'), false;
+    if (requested <= 0) return error.assign("The time_limit must be positive.\n"), false;
+    if (!(time_limit > 0) || requested < time_limit) time_limit = requested;
+  }
+  return true;
+}
+
 const string parsito_service::default_input_format = "conllu";
 
 tree_input_format* parsito_service::get_input_format(microrestd::rest_request& req, string& error) {
@@ -28,12 +28,16 @@ class parsito_service : public microrestd::rest_service {
   struct model_description {
     string rest_id, file, acknowledgements;
     unsigned beam_size;
+    string cascade_file;
+    float cascade_margin;
 
-    model_description(const string& rest_id, const string& file, const string& acknowledgements, unsigned beam_size)
-        : rest_id(rest_id), file(file), acknowledgements(acknowledgements), beam_size(beam_size) {}
+    model_description(const string& rest_id, const string& file, const string& acknowledgements, unsigned beam_size,
+                      const string& cascade_file = string(), float cascade_margin = 0)
+        : rest_id(rest_id), file(file), acknowledgements(acknowledgements), beam_size(beam_size),
+          cascade_file(cascade_file), cascade_margin(cascade_margin) {}
   };
 
-  bool init(const vector<model_description>& model_descriptions);
+  bool init(const vector<model_description>& model_descriptions, const Parser::load_options& options = Parser::load_options(), double time_limit = 0);
 
   virtual bool handle(microrestd::rest_request& req) override;
 
@@ -71,7 +75,10 @@ class parsito_service : public microrestd::rest_service {
   tree_input_format* get_input_format(microrestd::rest_request& req, string& error);
   tree_output_format* get_output_format(microrestd::rest_request& req, string& error);
 
+  bool get_time_limit(microrestd::rest_request& req, double& time_limit, string& error);
+
   microrestd::json_builder json_models;
+  double time_limit;
 
   static const string default_input_format;
   static const string default_output_format;
@@ -7,35 +7,60 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
+#include <fstream>
+
 #include "common.h"
 #include "parser/parser.h"
+#include "parser/parser_cascade.h"
+#include "parser/parser_nn.h"
 #include "utils/iostreams.h"
 #include "utils/options.h"
+#include "utils/parse_double.h"
 #include "utils/parse_int.h"
+#include "utils/path_from_utf8.h"
 #include "utils/process_args.h"
 #include "tree/tree_format.h"
 #include "version/version.h"
 
 using namespace ufal::parsito;
 
-void parse(istream& in, ostream& out, const parser& p, tree_input_format& input_format, const tree_output_format& output_format, unsigned beam_size) {
+void parse(istream& in, ostream& out, const parser& p, tree_input_format& input_format, const tree_output_format& output_format,
+           unsigned beam_size, unsigned batch_size, const parser::parse_budget* budget, unsigned& degraded) {
   string input, output;
+  vector<string> inputs;
+  vector<tree> trees;
   tree t;
 
-  // Read blocks containing input trees
-  while (input_format.read_block(in, input)) {
-    // Process all trees in the block
-    input_format.set_text(input);
-    while (input_format.next_tree(t)) {
-      // Parse the tree
-      p.parse(t, beam_size);
-
-      // Output the parsed tree
-      output_format.write_tree(t, output, &input_format);
-      out << output << flush;
+  for (bool more_input = true; more_input; ) {
+    // Read blocks containing input trees, until batch_size trees are read
+    inputs.clear();
+    trees.clear();
+    while (trees.size() < batch_size && (more_input = input_format.read_block(in, input))) {
+      input_format.set_text(input);
+      while (input_format.next_tree(t))
+        trees.push_back(t);
+      if (!input_format.last_error().empty())
+        runtime_failure(input_format.last_error());
+      inputs.push_back(input);
+    }
+
+    // Parse all the trees at once, or one by one when using a budget
+    if (budget) {
+      for (auto&& input_tree : trees)
+        degraded += p.parse(input_tree, beam_size, *budget) != parser::NOT_DEGRADED;
+    } else {
+      p.parse_batch(trees, beam_size);
+    }
+
+    // Output the parsed trees, reading the blocks again to provide additional information
+    size_t tree_index = 0;
+    for (auto&& input : inputs) {
+      input_format.set_text(input);
+      while (input_format.next_tree(t)) {
+        output_format.write_tree(trees[tree_index++], output, &input_format);
+        out << output << flush;
+      }
     }
-    if (!input_format.last_error().empty())
-      runtime_failure(input_format.last_error());
   }
 }
 
@@ -46,6 +71,25 @@ int main(int argc, char* argv[]) {
   if (!options::parse({{"input", options::value{"conllu"}},
                        {"output", options::value{"conllu"}},
                        {"beam_size", options::value::any},
+                       {"beam_threads", options::value::any},
+                       {"beam_recombination", options::value::none},
+                       {"beam_min_length", options::value::any},
+                       {"beam_max_length", options::value::any},
+                       {"beam_margin", options::value::any},
+                       {"batch_size", options::value::any},
+                       {"cascade_model", options::value::any},
+                       {"cascade_margin", options::value::any},
+                       {"step_limit", options::value::any},
+                       {"time_limit", options::value::any},
+                       {"cache_file", options::value::any},
+                       {"cache_precision", options::value{"float32", "float16", "bfloat16", "int8"}},
+                       {"cache_threads", options::value::any},
+                       {"cache_lazy", options::value::none},
+                       {"cache_memory", options::value::any},
+                       {"cache_profile", options::value::any},
+                       {"save_cache_profile", options::value::any},
+                       {"quantize", options::value::none},
+                       {"workspace_memory", options::value::any},
                        {"version", options::value::none},
                        {"help", options::value::none}}, argc, argv, options) ||
       options.count("help") ||
@@ -54,6 +98,25 @@ int main(int argc, char* argv[]) {
                     "Options: --input=conllu\n"
                     "         --output=conllu\n"
                     "         --beam_size=beam size during decoding\n"
+                    "         --beam_threads=threads expanding the beam of a sentence\n"
+                    "         --beam_recombination (merge beam configurations with identical features)\n"
+                    "         --beam_min_length=minimum sentence length for beam search\n"
+                    "         --beam_max_length=maximum sentence length for beam search\n"
+                    "         --beam_margin=use beam search only for greedy decisions with smaller margin\n"
+                    "         --batch_size=number of sentences parsed together\n"
+                    "         --cascade_model=large model reparsing sentences the model_file is unsure of\n"
+                    "         --cascade_margin=reparse sentences with smaller greedy margin (default 0.5)\n"
+                    "         --step_limit=maximum network evaluations of a sentence\n"
+                    "         --time_limit=maximum parsing time of a sentence in seconds\n"
+                    "         --cache_file=embeddings cache file created by parsito_cache\n"
+                    "         --cache_precision=float32|float16|bfloat16|int8\n"
+                    "         --cache_threads=threads used to compute the cache\n"
+                    "         --cache_lazy (compute the cache on first use)\n"
+                    "         --cache_memory=maximum lazy or profiled cache size in MB\n"
+                    "         --cache_profile=cache the words most frequent in given profile\n"
+                    "         --save_cache_profile=save profile of the embedding lookups\n"
+                    "         --quantize (use int8 quantized network)\n"
+                    "         --workspace_memory=maximum memory in MB kept by a workspace\n"
                     "         --version\n"
                     "         --help");
   if (options.count("version"))
@@ -72,15 +135,117 @@ int main(int argc, char* argv[]) {
   int beam_size = options.count("beam_size") ? parse_int(options["beam_size"], "beam_size") : 0;
   if (beam_size < 0) runtime_failure("Beam size cannot be negative!");
 
+  int batch_size = options.count("batch_size") ? parse_int(options["batch_size"], "batch_size") : 1;
+  if (batch_size <= 0) runtime_failure("Batch size must be positive!");
+
+  double cascade_margin = 0.5;
+  if (options.count("cascade_margin")) {
+    if (!options.count("cascade_model")) runtime_failure("The cascade margin can be used only with a cascade model!");
+    cascade_margin = parse_double(options["cascade_margin"], "cascade_margin");
+    if (cascade_margin <= 0) runtime_failure("The cascade margin must be positive!");
+  }
+
+  unique_ptr<parser::parse_budget> budget;
+  if (options.count("step_limit") || options.count("time_limit")) {
+    if (options.count("batch_size")) runtime_failure("The batch size cannot be used together with a step or time limit!");
+    budget.reset(new parser::parse_budget());
+    if (options.count("step_limit")) {
+      int step_limit = parse_int(options["step_limit"], "step_limit");
+      if (step_limit <= 0) runtime_failure("The step limit must be positive!");
+      budget->steps = step_limit;
+    }
+    if (options.count("time_limit")) {
+      budget->seconds = parse_double(options["time_limit"], "time_limit");
+      if (budget->seconds <= 0) runtime_failure("The time limit must be positive!");
+    }
+  }
+
+  parser::load_options load_options;
+  load_options.quantized = options.count("quantize");
+  if (options.count("cache_file")) load_options.cache_file = options["cache_file"];
+  if (options.count("beam_threads")) {
+    int beam_threads = parse_int(options["beam_threads"], "beam_threads");
+    if (beam_threads <= 0) runtime_failure("The number of beam threads must be positive!");
+    load_options.beam_threads = beam_threads;
+  }
+  load_options.beam_recombination = options.count("beam_recombination");
+  if (options.count("beam_min_length")) {
+    int beam_min_length = parse_int(options["beam_min_length"], "beam_min_length");
+    if (beam_min_length < 0) runtime_failure("The minimum beam search sentence length cannot be negative!");
+    load_options.beam_min_length = beam_min_length;
+  }
+  if (options.count("beam_max_length")) {
+    int beam_max_length = parse_int(options["beam_max_length"], "beam_max_length");
+    if (beam_max_length < 0) runtime_failure("The maximum beam search sentence length cannot be negative!");
+    load_options.beam_max_length = beam_max_length;
+  }
+  if (options.count("beam_margin")) {
+    load_options.beam_margin = parse_double(options["beam_margin"], "beam_margin");
+    if (load_options.beam_margin < 0) runtime_failure("The beam search margin cannot be negative!");
+  }
+  if (options.count("cache_threads")) {
+    int cache_threads = parse_int(options["cache_threads"], "cache_threads");
+    if (cache_threads <= 0) runtime_failure("The number of cache threads must be positive!");
+    load_options.cache_threads = cache_threads;
+  }
+  if (options.count("cache_lazy")) {
+    load_options.cache = parser::FULL_CACHE;
+    load_options.cache_lazy = true;
+  }
+  if (options.count("cache_memory")) {
+    int cache_memory = parse_int(options["cache_memory"], "cache_memory");
+    if (cache_memory < 0) runtime_failure("The cache memory limit cannot be negative!");
+    load_options.cache_memory = cache_memory;
+  }
+  if (options.count("cache_profile")) load_options.cache_profile = options["cache_profile"];
+  if (options.count("workspace_memory")) {
+    int workspace_memory = parse_int(options["workspace_memory"], "workspace_memory");
+    if (workspace_memory < 0) runtime_failure("The workspace memory limit cannot be negative!");
+    load_options.workspace_memory = workspace_memory;
+  }
+  if (options.count("cache_precision")) {
+    const string& precision = options["cache_precision"];
+    load_options.cache_precision = precision == "float32" ? parser::load_options::FLOAT32 :
+        precision == "float16" ? parser::load_options::FLOAT16 :
+        precision == "bfloat16" ? parser::load_options::BFLOAT16 : parser::load_options::INT8;
+  }
+
   cerr << "Loading parser: ";
-  unique_ptr<parser> p(parser::load(argv[1]));
-  if (!p)
-    runtime_failure("Cannot load parser from file '" << argv[1] << "'!");
+  unique_ptr<parser> p;
+  if (options.count("cascade_model")) {
+    p.reset(parser_cascade::load(argv[1], options["cascade_model"].c_str(), cascade_margin,
+                                 parser_cascade::small_load_options(load_options), load_options));
+    if (!p)
+      runtime_failure("Cannot load parser cascade from nn parser file '" << argv[1] << "' and parser file '" << options["cascade_model"] << "'!");
+  } else {
+    p.reset(parser::load(argv[1], load_options));
+    if (!p)
+      runtime_failure("Cannot load parser from file '" << argv[1] << "'!");
+  }
   cerr << "done" << endl;
 
+  parser_nn* profiled = nullptr;
+  if (options.count("save_cache_profile")) {
+    profiled = dynamic_cast<parser_nn*>(p.get());
+    if (!profiled)
+      runtime_failure("Only the nn parser models without a cascade support cache profiles!");
+    profiled->start_embeddings_profile();
+  }
+
   clock_t now = clock();
-  process_args(2, argc, argv, parse, *p, *input_format, *output_format, beam_size);
+  unsigned degraded = 0;
+  process_args(2, argc, argv, parse, *p, *input_format, *output_format, beam_size, batch_size, budget.get(), degraded);
   cerr << "Parsing done, in " << fixed << setprecision(3) << (clock() - now) / double(CLOCKS_PER_SEC) << " seconds." << endl;
+  if (budget) cerr << "Parsing of " << degraded << " sentences exceeded the budget and was degraded." << endl;
+
+  if (profiled) {
+    const string& profile_file_name = options["save_cache_profile"];
+    ofstream profile_file(path_from_utf8(profile_file_name).c_str(), ofstream::out | ofstream::binary);
+    if (!profile_file.is_open())
+      runtime_failure("Cannot open file '" << profile_file_name << "' for writing!");
+    if (!profiled->save_embeddings_profile(profile_file))
+      runtime_failure("Cannot save the cache profile to file '" << profile_file_name << "'!");
+  }
 
   return 0;
 }
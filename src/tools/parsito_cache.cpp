@@ -0,0 +1,91 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+#include "common.h"
+#include "parser/parser_nn.h"
+#include "utils/iostreams.h"
+#include "utils/options.h"
+#include "utils/parse_int.h"
+#include "utils/path_from_utf8.h"
+#include "version/version.h"
+
+using namespace ufal::parsito;
+
+int main(int argc, char* argv[]) {
+  iostreams_init();
+
+  options::map options;
+  if (!options::parse({{"cache", options::value::any},
+                       {"cache_precision", options::value{"float32", "float16", "bfloat16", "int8"}},
+                       {"cache_threads", options::value::any},
+                       {"cache_memory", options::value::any},
+                       {"cache_profile", options::value::any},
+                       {"version", options::value::none},
+                       {"help", options::value::none}}, argc, argv, options) ||
+      options.count("help") ||
+      (argc < 3 && !options.count("version")))
+    runtime_failure("Usage: " << argv[0] << " [options] model_file cache_file\n"
+                    "Options: --cache=number of cached words [all]\n"
+                    "         --cache_precision=float32|float16|bfloat16|int8\n"
+                    "         --cache_threads=threads used to compute the cache [all cores]\n"
+                    "         --cache_memory=maximum profiled cache size in MB\n"
+                    "         --cache_profile=cache the words most frequent in given profile\n"
+                    "         --version\n"
+                    "         --help");
+  if (options.count("version"))
+    return cout << version::version_and_copyright() << endl, 0;
+
+  parser::load_options load_options(parser::FULL_CACHE);
+  if (options.count("cache")) {
+    int cache = parse_int(options["cache"], "cache");
+    if (cache < 0) runtime_failure("The number of cached words cannot be negative!");
+    load_options.cache = cache;
+  }
+  load_options.cache_threads = max(thread::hardware_concurrency(), 1U);
+  if (options.count("cache_threads")) {
+    int cache_threads = parse_int(options["cache_threads"], "cache_threads");
+    if (cache_threads <= 0) runtime_failure("The number of cache threads must be positive!");
+    load_options.cache_threads = cache_threads;
+  }
+  if (options.count("cache_memory")) {
+    int cache_memory = parse_int(options["cache_memory"], "cache_memory");
+    if (cache_memory < 0) runtime_failure("The cache memory limit cannot be negative!");
+    load_options.cache_memory = cache_memory;
+  }
+  if (options.count("cache_profile")) load_options.cache_profile = options["cache_profile"];
+  if (options.count("cache_precision")) {
+    const string& precision = options["cache_precision"];
+    load_options.cache_precision = precision == "float32" ? parser::load_options::FLOAT32 :
+        precision == "float16" ? parser::load_options::FLOAT16 :
+        precision == "bfloat16" ? parser::load_options::BFLOAT16 : parser::load_options::INT8;
+  }
+
+  cerr << "Loading parser: ";
+  unique_ptr<parser> p(parser::load(argv[1], load_options));
+  if (!p)
+    runtime_failure("Cannot load parser from file '" << argv[1] << "'!");
+  auto p_nn = dynamic_cast<parser_nn*>(p.get());
+  if (!p_nn)
+    runtime_failure("Only the nn parser models are supported!");
+  cerr << "done" << endl;
+
+  cerr << "Saving embeddings cache: ";
+  ofstream cache_file(path_from_utf8(argv[2]).c_str(), ofstream::out | ofstream::binary);
+  if (!cache_file.is_open())
+    runtime_failure("Cannot open file '" << argv[2] << "' for writing!");
+  if (!p_nn->save_embeddings_cache(cache_file))
+    runtime_failure("Cannot save the embeddings cache to file '" << argv[2] << "'!");
+  cerr << "done" << endl;
+
+  return 0;
+}
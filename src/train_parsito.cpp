@@ -26,7 +26,8 @@ using namespace ufal::parsito;
 
 void train_parser_nn(int argc, char* argv[]) {
   options::map options;
-  if (!options::parse({{"adadelta", options::value::any},
+  if (!options::parse({{"activation_l1_regularization", options::value::any},
+                       {"adadelta", options::value::any},
                        {"adagrad", options::value::any},
                        {"adam", options::value::any},
                        {"batch_size", options::value::any},
@@ -36,7 +37,7 @@ void train_parser_nn(int argc, char* argv[]) {
                        {"embeddings", options::value::any},
                        {"heldout", options::value::any},
                        {"hidden_layer", options::value::any},
-                       {"hidden_layer_type", options::value{"cubic","tanh"}},
+                       {"hidden_layer_type", options::value{"cubic","tanh","relu"}},
                        {"initialization_range", options::value::any},
                        {"input", options::value{"conllu"}},
                        {"iterations", options::value::any},
@@ -55,7 +56,8 @@ void train_parser_nn(int argc, char* argv[]) {
                        {"help", options::value::none}}, argc, argv, options) ||
       options.count("help"))
     runtime_failure("Usage: " << argv[0] << " nn [options]\n"
-                    "Options: --adadelta=momentum,epsilon\n"
+                    "Options: --activation_l1_regularization=hidden layer activation l1 regularization factor\n"
+                    "         --adadelta=momentum,epsilon\n"
                     "         --adagrad=learning rate,epsilon\n"
                     "         --adam=learning rate[,beta1,beta2,final learning rate]\n"
                     "         --batch_size=batch size\n"
@@ -65,7 +67,7 @@ void train_parser_nn(int argc, char* argv[]) {
                     "         --embeddings=embedding description file\n"
                     "         --heldout=heldout data file\n"
                     "         --hidden_layer=hidden layer size\n"
-                    "         --hidden_layer_type=cubic|tanh (hidden layer activation function)\n"
+                    "         --hidden_layer_type=cubic|tanh|relu (hidden layer activation function)\n"
                     "         --initialization_range=initialization range\n"
                     "         --input=conllu (input format)\n"
                     "         --iterations=number of training iterations\n"
@@ -104,6 +106,8 @@ void train_parser_nn(int argc, char* argv[]) {
   parameters.l1_regularization = options.count("l1_regularization") ? parse_double(options["l1_regularization"], "l1 regularization") : 0;
   parameters.l2_regularization = options.count("l2_regularization") ? parse_double(options["l2_regularization"], "l2 regularization") : 0;
   parameters.maxnorm_regularization = options.count("maxnorm_regularization") ? parse_double(options["maxnorm_regularization"], "max-norm regularization") : 0;
+  parameters.activation_l1_regularization = options.count("activation_l1_regularization") ?
+      parse_double(options["activation_l1_regularization"], "activation l1 regularization") : 0;
   parameters.dropout_hidden = options.count("dropout_hidden") ? parse_double(options["dropout_hidden"], "hidden layer dropout") : 0;
   parameters.dropout_input = options.count("dropout_input") ? parse_double(options["dropout_input"], "input dropout") : 0;
   parameters.early_stopping = options.count("early_stopping") ? parse_int(options["early_stopping"], "early stopping") : options.count("heldout");
@@ -23,6 +23,8 @@ class transition_system {
   virtual unsigned transition_count() const;
   virtual bool applicable(const configuration& conf, unsigned transition) const;
   virtual int perform(configuration& conf, unsigned transition) const;
+  // Index of the label assigned by the transition, or -1 if it assigns none
+  virtual int label(unsigned transition) const = 0;
   virtual transition_oracle* oracle(const string& name) const = 0;
 
   static transition_system* create(const string& name, const vector<string>& labels);
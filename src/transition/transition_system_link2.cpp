@@ -22,6 +22,10 @@ transition_system_link2::transition_system_link2(const vector<string>& labels) :
   }
 }
 
+int transition_system_link2::label(unsigned transition) const {
+  return transition ? int(transition - 1) / 4 : -1;
+}
+
 // Static oracle
 class transition_system_link2_oracle_static : public transition_oracle {
  public:
@@ -19,6 +19,7 @@ class transition_system_link2 : public transition_system {
  public:
   transition_system_link2(const vector<string>& labels);
 
+  virtual int label(unsigned transition) const override;
   virtual transition_oracle* oracle(const string& name) const override;
 };
 
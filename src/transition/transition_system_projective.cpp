@@ -22,6 +22,10 @@ transition_system_projective::transition_system_projective(const vector<string>&
   }
 }
 
+int transition_system_projective::label(unsigned transition) const {
+  return transition ? int(transition - 1) / 2 : -1;
+}
+
 // Static oracle
 class transition_system_projective_oracle_static : public transition_oracle {
  public:
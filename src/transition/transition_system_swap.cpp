@@ -21,6 +21,10 @@ transition_system_swap::transition_system_swap(const vector<string>& labels) : t
   }
 }
 
+int transition_system_swap::label(unsigned transition) const {
+  return transition >= 2 ? int(transition - 2) / 2 : -1;
+}
+
 // Static oracle
 class transition_system_swap_oracle_static : public transition_oracle {
  public:
@@ -20,6 +20,7 @@ vector<string> namespaces_opening;
 vector<string> namespaces_closing;
 
 set<string> system_includes;
+vector<string> conditional_system_includes;
 set<string> local_includes;
 
 struct bundle_file {
@@ -41,7 +42,7 @@ void add_file(list<bundle_file>::iterator it, const string& top_directory, const
 
   // Before opening the namespaces, there should be only
   // - comments
-  // - system includes
+  // - system includes, optionally in a #if/#endif block
   // - local includes
   // - #pragma once
   string line;
@@ -52,6 +53,18 @@ void add_file(list<bundle_file>::iterator it, const string& top_directory, const
     } else if (line == "#pragma once") {
     } else if (line.find("#include <") == 0 && line.substr(line.size() - 1) == ">") {
       system_includes.insert(string(line, 10, line.size() - 11));
+    } else if (line.find("#if") == 0) {
+      // Keep the whole conditional block verbatim
+      string block = line;
+      for (int depth = 1; depth; ) {
+        if (!getline(is, line)) cerr << "Unterminated conditional block " << block << " in file " << file << "!" << endl, exit(1);
+        if (line.find("#include \"") == 0) cerr << "Local include " << line << " in a conditional block in file " << file << " is not supported!" << endl, exit(1);
+        if (line.find("#if") == 0) depth++;
+        if (line.find("#endif") == 0) depth--;
+        block.append("\n").append(line);
+      }
+      if (find(conditional_system_includes.begin(), conditional_system_includes.end(), block) == conditional_system_includes.end())
+        conditional_system_includes.push_back(block);
     } else if (line.find("#include \"") == 0) {
       string header_path;
       for (int location = 0; header_path.empty() && location <= 1; location++) {
@@ -120,6 +133,8 @@ int main(int argc, char* argv[]) {
   cout << endl;
   for (auto&& system_include : system_includes)
     cout << "#include <" << system_include << ">" << endl;
+  for (auto&& conditional_system_include : conditional_system_includes)
+    cout << endl << conditional_system_include << endl;
 
   cout << endl;
   for (auto&& namespace_opening : namespaces_opening)